@@ -0,0 +1,550 @@
+#include <sys/param.h>
+#include <err.h>
+#include <stdio.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+
+#include "bench.h"
+#include "hwcap.h"
+
+/*
+ * Throughput benchmarks for crypto and checksum primitives (-b).
+ * Each kernel processes a buffer that fits into L2 cache over and
+ * over for BENCH_TIME nanoseconds.  The best of BENCH_TRIALS trials
+ * is reported.
+ */
+#define BENCH_BUFSIZE	(16 * 1024)
+#define BENCH_TRIALS	5
+#define BENCH_TIME	10000000	/* ns */
+
+/* the primitives benchmarked, in order */
+static const char *const primitives[] = {
+	"aes-gcm",
+	"crc32c",
+	"sha256",
+	"clmul",
+	NULL,
+};
+
+/*
+ * AES-128-GCM encryption with the key 00 01 ... 0f, the way the
+ * accelerated kernels do it: the ciphertext is computed in CTR mode,
+ * starting with the counter 2, and hashed with GHASH.  This version
+ * goes byte by byte and bit by bit, as a reference.
+ */
+#define XTIME(b)	(((b) << 1 ^ ((b) & 0x80 ? 0x1b : 0)) & 0xff)
+#define ROL8(b, n)	(((b) << (n) | (b) >> (8 - (n))) & 0xff)
+
+static unsigned char aes_sbox[256], aes_rk[11][16];
+static unsigned long long gcm_h[2];	/* H, big endian halves */
+static int gcm_ready = 0;
+
+static void
+aes_encrypt(unsigned char b[16])
+{
+	unsigned char t[16];
+	unsigned x;
+	int r, i;
+
+	for (i = 0; i < 16; i++)
+		b[i] ^= aes_rk[0][i];
+
+	for (r = 1; r <= 10; r++) {
+		/* SubBytes and ShiftRows */
+		for (i = 0; i < 16; i++)
+			t[i] = aes_sbox[b[(i + 4 * (i % 4)) % 16]];
+
+		/* MixColumns, except in the last round */
+		if (r == 10) {
+			memcpy(b, t, sizeof(t));
+		} else {
+			for (i = 0; i < 16; i += 4) {
+				x = t[i] ^ t[i + 1] ^ t[i + 2] ^ t[i + 3];
+				b[i] = t[i] ^ x ^ XTIME(t[i] ^ t[i + 1]);
+				b[i + 1] = t[i + 1] ^ x ^ XTIME(t[i + 1] ^ t[i + 2]);
+				b[i + 2] = t[i + 2] ^ x ^ XTIME(t[i + 2] ^ t[i + 3]);
+				b[i + 3] = t[i + 3] ^ x ^ XTIME(t[i + 3] ^ t[i]);
+			}
+		}
+
+		for (i = 0; i < 16; i++)
+			b[i] ^= aes_rk[r][i];
+	}
+}
+
+static unsigned long long
+load_be64(const unsigned char *b)
+{
+	unsigned long long x = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		x = x << 8 | b[i];
+
+	return (x);
+}
+
+/* x = x * H in GF(2^128), bit-reflected as GCM has it */
+static void
+ghash_mul(unsigned long long x[2])
+{
+	unsigned long long z[2] = { 0, 0 }, v[2], carry;
+	int i;
+
+	v[0] = gcm_h[0];
+	v[1] = gcm_h[1];
+	for (i = 0; i < 128; i++) {
+		if (x[i / 64] >> (63 - i % 64) & 1) {
+			z[0] ^= v[0];
+			z[1] ^= v[1];
+		}
+
+		/* v = v * x, reducing modulo x^128 + x^7 + x^2 + x + 1 */
+		carry = v[1] & 1;
+		v[1] = v[1] >> 1 | v[0] << 63;
+		v[0] = v[0] >> 1 ^ (carry ? 0xe100000000000000ULL : 0);
+	}
+
+	x[0] = z[0];
+	x[1] = z[1];
+}
+
+static void
+gcm_init(void)
+{
+	unsigned char p = 1, q = 1, rcon = 1, blk[16];
+	int i, j;
+
+	if (gcm_ready)
+		return;
+
+	/* the S-box: p runs through the powers of 3, q through their inverses */
+	do {
+		p ^= XTIME(p);
+		q ^= q << 1;
+		q ^= q << 2;
+		q ^= q << 4;
+		if (q & 0x80)
+			q ^= 0x09;
+
+		aes_sbox[p] = q ^ ROL8(q, 1) ^ ROL8(q, 2) ^ ROL8(q, 3) ^ ROL8(q, 4) ^ 0x63;
+	} while (p != 1);
+
+	aes_sbox[0] = 0x63;
+
+	for (i = 0; i < 16; i++)
+		aes_rk[0][i] = i;
+
+	for (i = 1; i < 11; i++) {
+		aes_rk[i][0] = aes_rk[i - 1][0] ^ aes_sbox[aes_rk[i - 1][13]] ^ rcon;
+		aes_rk[i][1] = aes_rk[i - 1][1] ^ aes_sbox[aes_rk[i - 1][14]];
+		aes_rk[i][2] = aes_rk[i - 1][2] ^ aes_sbox[aes_rk[i - 1][15]];
+		aes_rk[i][3] = aes_rk[i - 1][3] ^ aes_sbox[aes_rk[i - 1][12]];
+		for (j = 4; j < 16; j++)
+			aes_rk[i][j] = aes_rk[i - 1][j] ^ aes_rk[i][j - 4];
+
+		rcon = XTIME(rcon);
+	}
+
+	/* H = AES_K(0) */
+	memset(blk, 0, sizeof(blk));
+	aes_encrypt(blk);
+	gcm_h[0] = load_be64(blk);
+	gcm_h[1] = load_be64(blk + 8);
+
+	gcm_ready = 1;
+}
+
+static unsigned long
+aes_gcm_generic(const unsigned char *buf, size_t len)
+{
+	unsigned long long x[2] = { 0, 0 }, ctr = 2;
+	unsigned char blk[16];
+	size_t i;
+	int j;
+
+	gcm_init();
+
+	len -= len % (GCM_BATCH * 16);
+	for (i = 0; i < len; i += 16) {
+		memset(blk, 0, 8);
+		for (j = 0; j < 8; j++)
+			blk[8 + j] = ctr >> (56 - 8 * j);
+
+		ctr++;
+		aes_encrypt(blk);
+		for (j = 0; j < 16; j++)
+			blk[j] ^= buf[i + j];
+
+		x[0] ^= load_be64(blk);
+		x[1] ^= load_be64(blk + 8);
+		ghash_mul(x);
+	}
+
+	/* the low half of the byte-swapped hash the other kernels return */
+	return (x[1]);
+}
+
+/* CRC-32C (Castagnoli), bit-reflected */
+#define CRC32C_POLY 0x82f63b78U
+
+static unsigned crc32c_table[256];
+
+static void
+crc32c_init(void)
+{
+	unsigned i, j, crc;
+
+	for (i = 0; i < 256; i++) {
+		crc = i;
+		for (j = 0; j < 8; j++)
+			crc = crc & 1 ? crc >> 1 ^ CRC32C_POLY : crc >> 1;
+
+		crc32c_table[i] = crc;
+	}
+}
+
+static unsigned long
+crc32c_generic(const unsigned char *buf, size_t len)
+{
+	unsigned crc = ~0U;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		crc = crc >> 8 ^ crc32c_table[(crc ^ buf[i]) & 0xff];
+
+	return (~crc);
+}
+
+/* a * b modulo the CRC-32C polynomial, bit-reflected */
+static unsigned
+crc32c_multmodp(unsigned a, unsigned b)
+{
+	unsigned m = 1U << 31, p = 0;
+
+	for (;;) {
+		if (a & m) {
+			p ^= b;
+			if ((a & (m - 1)) == 0)
+				break;
+		}
+
+		m >>= 1;
+		b = b & 1 ? b >> 1 ^ CRC32C_POLY : b >> 1;
+	}
+
+	return (p);
+}
+
+/*
+ * Return crc * x^(8 len) modulo the CRC-32C polynomial.  This is what
+ * the CRC of a message turns into when len zero bytes are appended,
+ * allowing the CRCs of consecutive buffers computed in parallel to be
+ * combined: crc(a || b) = crc32c_shift(crc(a), len(b)) ^ crc(b), where
+ * crc(b) is computed with an initial value of zero.
+ */
+static unsigned
+crc32c_shift(unsigned crc, size_t len)
+{
+	unsigned xpow = 1U << 30;	/* x^1 */
+	unsigned p = 1U << 31;		/* x^0 */
+
+	/* x^(8 len) by square and multiply */
+	for (len *= 8; len > 0; len >>= 1) {
+		if (len & 1)
+			p = crc32c_multmodp(xpow, p);
+
+		xpow = crc32c_multmodp(xpow, xpow);
+	}
+
+	return (crc32c_multmodp(p, crc));
+}
+
+/*
+ * crc32c_shift(crc, len) is linear in crc, so for a fixed len it can
+ * be evaluated with one table lookup per byte of crc:
+ *
+ *     table[0][crc & 0xff] ^ table[1][crc >> 8 & 0xff] ^ ...
+ */
+void
+crc32c_shift_table(unsigned table[4][256], size_t len)
+{
+	unsigned i, j;
+
+	for (i = 0; i < 4; i++)
+		for (j = 0; j < 256; j++)
+			table[i][j] = crc32c_shift(j << 8 * i, len);
+}
+
+/* SHA-256 (FIPS 180-4) */
+const unsigned sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const unsigned sha256_iv[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+#define ROR32(x, n) ((x) >> (n) | (x) << (32 - (n)))
+
+static unsigned long
+sha256_generic(const unsigned char *buf, size_t len)
+{
+	unsigned h[8], w[64], a, b, c, d, e, f, g, hh, t1, t2;
+	size_t i, j;
+
+	memcpy(h, sha256_iv, sizeof(h));
+
+	for (i = 0; i + 64 <= len; i += 64) {
+		for (j = 0; j < 16; j++)
+			w[j] = (unsigned)buf[i + 4 * j] << 24
+			    | (unsigned)buf[i + 4 * j + 1] << 16
+			    | (unsigned)buf[i + 4 * j + 2] << 8
+			    | (unsigned)buf[i + 4 * j + 3];
+
+		for (j = 16; j < 64; j++)
+			w[j] = w[j - 16] + w[j - 7]
+			    + (ROR32(w[j - 15], 7) ^ ROR32(w[j - 15], 18) ^ w[j - 15] >> 3)
+			    + (ROR32(w[j - 2], 17) ^ ROR32(w[j - 2], 19) ^ w[j - 2] >> 10);
+
+		a = h[0]; b = h[1]; c = h[2]; d = h[3];
+		e = h[4]; f = h[5]; g = h[6]; hh = h[7];
+
+		for (j = 0; j < 64; j++) {
+			t1 = hh + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25))
+			    + ((e & f) ^ (~e & g)) + sha256_k[j] + w[j];
+			t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22))
+			    + ((a & b) ^ (a & c) ^ (b & c));
+			hh = g; g = f; f = e; e = d + t1;
+			d = c; c = b; b = a; a = t1 + t2;
+		}
+
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+		h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+	}
+
+	return (h[0]);
+}
+
+/* 64 x 64 -> 128 bit carryless multiply */
+static void
+clmul64(unsigned long long a, unsigned long long b, unsigned long long p[2])
+{
+	int j;
+
+	p[0] = p[1] = 0;
+	for (j = 0; j < 64; j++)
+		if (b >> j & 1) {
+			p[0] ^= a << j;
+			p[1] ^= j == 0 ? 0 : a >> (64 - j);
+		}
+}
+
+/*
+ * Fold the buffer into CLMUL_LANES 128 bit accumulators by carryless
+ * multiplication, as done by CRC implementations.
+ */
+static unsigned long
+clmul_generic(const unsigned char *buf, size_t len)
+{
+	unsigned long long acc[CLMUL_LANES][2], word[2], lo[2], hi[2];
+	size_t i;
+	int j;
+
+	memset(acc, 0, sizeof(acc));
+	for (i = 0; i + CLMUL_LANES * 16 <= len; i += CLMUL_LANES * 16)
+		for (j = 0; j < CLMUL_LANES; j++) {
+			memcpy(word, buf + i + 16 * j, sizeof(word));
+			clmul64(acc[j][0], CLMUL_K_LO, lo);
+			clmul64(acc[j][1], CLMUL_K_HI, hi);
+			acc[j][0] = lo[0] ^ hi[0] ^ word[0];
+			acc[j][1] = lo[1] ^ hi[1] ^ word[1];
+		}
+
+	for (j = 1; j < CLMUL_LANES; j++)
+		acc[0][0] ^= acc[j][0];
+
+	return (acc[0][0]);
+}
+
+static const struct kernel generic_kernels[] = {
+	"aes-gcm", "generic", NULL, aes_gcm_generic,
+	"crc32c", "generic", NULL, crc32c_generic,
+	"sha256", "generic", NULL, sha256_generic,
+	"clmul", "generic", NULL, clmul_generic,
+	NULL, NULL, NULL, NULL,
+};
+
+static unsigned char bench_buf[BENCH_BUFSIZE] __attribute__((aligned(64)));
+
+/* defeats dead code elimination of the kernels */
+static volatile unsigned long bench_sink;
+
+static long long
+now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		err(EX_OSERR, "clock_gettime");
+
+	return (ts.tv_sec * 1000000000LL + ts.tv_nsec);
+}
+
+struct result {
+	const struct kernel *kernel;
+	double bytes_per_ns, bytes_per_tick;
+};
+
+static void
+measure(const struct kernel *k, struct result *res)
+{
+	long long start, elapsed;
+	unsigned long long ticks;
+	double bytes;
+	size_t iter;
+	int trial;
+
+	res->kernel = k;
+	res->bytes_per_ns = 0.0;
+	res->bytes_per_tick = 0.0;
+
+	/* warm up caches and clocks */
+	bench_sink = k->fn(bench_buf, sizeof(bench_buf));
+
+	for (trial = 0; trial < BENCH_TRIALS; trial++) {
+		iter = 0;
+		ticks = read_ticks();
+		start = now();
+		do {
+			bench_sink = k->fn(bench_buf, sizeof(bench_buf));
+			iter++;
+			elapsed = now() - start;
+		} while (elapsed < BENCH_TIME);
+
+		ticks = read_ticks() - ticks;
+		bytes = (double)iter * sizeof(bench_buf);
+
+		if (bytes / elapsed > res->bytes_per_ns) {
+			res->bytes_per_ns = bytes / elapsed;
+			res->bytes_per_tick = ticks != 0 ? bytes / ticks : 0.0;
+		}
+	}
+}
+
+static int
+want_primitive(char **args, const char *primitive)
+{
+	size_t i;
+
+	if (args[0] == NULL)
+		return (1);
+
+	for (i = 0; args[i] != NULL; i++)
+		if (strcmp(args[i], primitive) == 0)
+			return (1);
+
+	return (0);
+}
+
+/*
+ * Check that k computes the same as the generic kernel ref.  The
+ * length is odd, so the kernels' handling of the tail is checked, too.
+ */
+static void
+verify(const struct kernel *k, const struct kernel *ref)
+{
+	unsigned long want, got;
+
+	want = ref->fn(bench_buf, sizeof(bench_buf) - 1);
+	got = k->fn(bench_buf, sizeof(bench_buf) - 1);
+	if (got != want)
+		errx(EX_SOFTWARE, "%s %s: result 0x%lx differs from %s 0x%lx",
+		    k->primitive, k->variant, got, ref->variant, want);
+}
+
+/* benchmark every applicable kernel of primitive, return how many */
+static size_t
+bench_primitive(const char *primitive, struct result *res, size_t nres)
+{
+	const struct kernel *tables[] = { generic_kernels, arch_kernels }, *k;
+	const struct kernel *ref = NULL;
+	size_t i, n = 0;
+
+	for (i = 0; i < nitems(tables); i++)
+		for (k = tables[i]; k->primitive != NULL; k++) {
+			if (strcmp(k->primitive, primitive) != 0)
+				continue;
+
+			if (k->requires != NULL && eval_expr(k->requires) != 1)
+				continue;
+
+			if (n >= nres)
+				errx(EX_SOFTWARE, "too many kernels for %s", primitive);
+
+			/* the generic kernel comes first */
+			if (ref == NULL)
+				ref = k;
+			else
+				verify(k, ref);
+
+			measure(k, res + n++);
+		}
+
+	return (n);
+}
+
+void
+run_benchmarks(char **args)
+{
+	struct result res[16];
+	size_t i, j, n, best;
+
+	for (i = 0; args[i] != NULL; i++) {
+		for (j = 0; primitives[j] != NULL; j++)
+			if (strcmp(args[i], primitives[j]) == 0)
+				break;
+
+		if (primitives[j] == NULL)
+			errx(EX_USAGE, "unknown primitive: %s", args[i]);
+	}
+
+	crc32c_init();
+	for (i = 0; i < sizeof(bench_buf); i++)
+		bench_buf[i] = i * 0x9e3779b1U >> 24;
+
+	for (i = 0; primitives[i] != NULL; i++) {
+		if (!want_primitive(args, primitives[i]))
+			continue;
+
+		n = bench_primitive(primitives[i], res, nitems(res));
+
+		best = 0;
+		for (j = 1; j < n; j++)
+			if (res[j].bytes_per_ns > res[best].bytes_per_ns)
+				best = j;
+
+		for (j = 0; j < n; j++) {
+			printf("%-15s %-15s %7.2f GB/s", primitives[i],
+			    res[j].kernel->variant, res[j].bytes_per_ns);
+
+			if (res[j].bytes_per_tick != 0.0)
+				printf(" %6.2f B/%s", res[j].bytes_per_tick,
+				    tick_unit);
+
+			if (j == best && n > 1)
+				printf(" fastest");
+
+			putchar('\n');
+		}
+	}
+}
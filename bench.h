@@ -0,0 +1,33 @@
+/* benchmark kernels, see bench.c */
+#ifndef BENCH_H
+#define BENCH_H
+
+struct kernel {
+	const char *primitive, *variant;
+	const char *requires;		/* capability expression, see -e */
+	unsigned long (*fn)(const unsigned char *, size_t);
+};
+
+/*
+ * Every implementation of a primitive computes the same result, which
+ * bench.c checks against the generic one.  aes-gcm hashes GCM_BATCH
+ * blocks per reduction and clmul folds CLMUL_LANES lanes of 16 bytes
+ * with the constant CLMUL_K_HI:CLMUL_K_LO.  Both ignore the part of
+ * the buffer that does not fill a whole batch.
+ */
+#define GCM_BATCH	8
+#define CLMUL_LANES	8
+#define CLMUL_K_LO	0x0000000154442bd4ULL
+#define CLMUL_K_HI	0x00000001c6e41596ULL
+
+/* provided by bench.c */
+void	run_benchmarks(char **);
+void	crc32c_shift_table(unsigned [4][256], size_t);
+extern	const unsigned	sha256_k[64], sha256_iv[8];
+
+/* provided by bench_$arch.c */
+extern	const struct kernel	arch_kernels[];
+extern	const char	tick_unit[];	/* "" if there is no counter */
+unsigned long long	read_ticks(void);
+
+#endif /* BENCH_H */
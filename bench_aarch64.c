@@ -0,0 +1,341 @@
+#include <sys/param.h>
+
+#include <arm_acle.h>
+#include <arm_neon.h>
+#include <string.h>
+
+#include "bench.h"
+
+/*
+ * Benchmark kernels using the aarch64 crypto and checksum extensions.
+ * Each kernel is compiled for the extensions it needs using the
+ * target attribute and only run if the capability expression in
+ * arch_kernels[] holds.
+ */
+
+/*
+ * The cycle counter (PMCCNTR_EL0) is usually not accessible from user
+ * space, so count ticks of the virtual counter instead.  CNTVCT_EL0
+ * runs at a fixed frequency (CNTFRQ_EL0, often tens of MHz) unrelated
+ * to the core clock, so a tick spans many core cycles.
+ */
+const char tick_unit[] = "CNTVCT tick";
+
+unsigned long long
+read_ticks(void)
+{
+	unsigned long long ticks;
+
+	asm volatile ("isb; mrs %0, cntvct_el0" : "=r"(ticks));
+
+	return (ticks);
+}
+
+/*
+ * AES-128-GCM encryption.  The ciphertext is computed in CTR mode
+ * and hashed with GHASH, aggregating the products of several blocks
+ * before reducing.  Trailing partial batches are ignored.
+ */
+static uint8x16_t aes_rk[11];
+static uint64x2_t gcm_h[GCM_BATCH];	/* gcm_h[i] = H^(i+1) */
+static int gcm_ready = 0;
+
+static uint8x16_t
+bswap128(uint8x16_t x)
+{
+	x = vrev64q_u8(x);
+
+	return (vextq_u8(x, x, 8));
+}
+
+/* SubWord(w), using that ShiftRows is a no-op on a splatted word */
+__attribute__((target("+aes")))
+static uint32_t
+aes_subword(uint32_t w)
+{
+	uint8x16_t x;
+
+	x = vaeseq_u8(vreinterpretq_u8_u32(vdupq_n_u32(w)), vdupq_n_u8(0));
+
+	return (vgetq_lane_u32(vreinterpretq_u32_u8(x), 0));
+}
+
+#define PMULL(a, b, i, j) vreinterpretq_u64_p128(vmull_p64( \
+	vgetq_lane_p64(vreinterpretq_p64_u64(a), i), \
+	vgetq_lane_p64(vreinterpretq_p64_u64(b), j)))
+
+/* the equivalents of _mm_slli_si128 and _mm_srli_si128 */
+#define SLL128(x, n) vreinterpretq_u64_u8(vextq_u8(vdupq_n_u8(0), vreinterpretq_u8_u64(x), 16 - (n)))
+#define SRL128(x, n) vreinterpretq_u64_u8(vextq_u8(vreinterpretq_u8_u64(x), vdupq_n_u8(0), (n)))
+#define SLL32(x, n) vreinterpretq_u64_u32(vshlq_n_u32(vreinterpretq_u32_u64(x), (n)))
+#define SRL32(x, n) vreinterpretq_u64_u32(vshrq_n_u32(vreinterpretq_u32_u64(x), (n)))
+
+/*
+ * Reduce the 256 bit product lo ^ mid << 64 ^ hi << 128 of two
+ * byte-swapped field elements modulo the GHASH polynomial.
+ */
+static uint64x2_t
+ghash_reduce(uint64x2_t lo, uint64x2_t mid, uint64x2_t hi)
+{
+	uint64x2_t t1, t2, t3;
+
+	lo = veorq_u64(lo, SLL128(mid, 8));
+	hi = veorq_u64(hi, SRL128(mid, 8));
+
+	/* the operands are bit-reflected: shift the product left by one */
+	t1 = SRL32(lo, 31);
+	t2 = SRL32(hi, 31);
+	lo = SLL32(lo, 1);
+	hi = SLL32(hi, 1);
+	t3 = SRL128(t1, 12);
+	t2 = SLL128(t2, 4);
+	t1 = SLL128(t1, 4);
+	lo = vorrq_u64(lo, t1);
+	hi = vorrq_u64(hi, t2);
+	hi = vorrq_u64(hi, t3);
+
+	/* reduce modulo x^128 + x^7 + x^2 + x + 1 */
+	t1 = SLL32(lo, 31);
+	t2 = SLL32(lo, 30);
+	t3 = SLL32(lo, 25);
+	t1 = veorq_u64(t1, veorq_u64(t2, t3));
+	t2 = SRL128(t1, 4);
+	t1 = SLL128(t1, 12);
+	lo = veorq_u64(lo, t1);
+	t1 = SRL32(lo, 1);
+	t1 = veorq_u64(t1, SRL32(lo, 2));
+	t1 = veorq_u64(t1, SRL32(lo, 7));
+	t1 = veorq_u64(t1, t2);
+	lo = veorq_u64(lo, t1);
+
+	return (veorq_u64(hi, lo));
+}
+
+__attribute__((target("+aes")))
+static uint64x2_t
+ghash_mul(uint64x2_t a, uint64x2_t b)
+{
+	uint64x2_t mid;
+
+	mid = veorq_u64(PMULL(a, b, 0, 1), PMULL(a, b, 1, 0));
+
+	return (ghash_reduce(PMULL(a, b, 0, 0), mid, PMULL(a, b, 1, 1)));
+}
+
+__attribute__((target("+aes")))
+static uint8x16_t
+aes_encrypt(uint8x16_t b)
+{
+	int r;
+
+	for (r = 0; r < 9; r++)
+		b = vaesmcq_u8(vaeseq_u8(b, aes_rk[r]));
+
+	return (veorq_u8(vaeseq_u8(b, aes_rk[9]), aes_rk[10]));
+}
+
+__attribute__((target("+aes")))
+static void
+gcm_init(void)
+{
+	static const uint8_t rcon[10] = {
+		0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36,
+	};
+	uint32_t w[44];
+	int i;
+
+	if (gcm_ready)
+		return;
+
+	for (i = 0; i < 4; i++)
+		w[i] = 0x03020100U + 0x04040404U * i;
+
+	for (i = 4; i < 44; i++)
+		if (i % 4 == 0)
+			w[i] = w[i - 4] ^ rcon[i / 4 - 1]
+			    ^ aes_subword(w[i - 1] >> 8 | w[i - 1] << 24);
+		else
+			w[i] = w[i - 4] ^ w[i - 1];
+
+	for (i = 0; i < 11; i++)
+		aes_rk[i] = vreinterpretq_u8_u32(vld1q_u32(&w[4 * i]));
+
+	/* H = AES_K(0) */
+	gcm_h[0] = vreinterpretq_u64_u8(bswap128(aes_encrypt(vdupq_n_u8(0))));
+	for (i = 1; i < GCM_BATCH; i++)
+		gcm_h[i] = ghash_mul(gcm_h[i - 1], gcm_h[0]);
+
+	gcm_ready = 1;
+}
+
+__attribute__((target("+aes")))
+static unsigned long
+aes_gcm_aes(const unsigned char *buf, size_t len)
+{
+	uint8x16_t blk[GCM_BATCH];
+	uint64x2_t ctr, x, lo, mid, hi, c, h;
+	size_t i;
+	int j, r;
+
+	gcm_init();
+
+	ctr = vcombine_u64(vcreate_u64(2), vcreate_u64(0));
+	x = vdupq_n_u64(0);
+
+	for (i = 0; i + GCM_BATCH * 16 <= len; i += GCM_BATCH * 16) {
+		for (j = 0; j < GCM_BATCH; j++) {
+			blk[j] = bswap128(vreinterpretq_u8_u64(ctr));
+			ctr = vaddq_u64(ctr, vcombine_u64(vcreate_u64(1), vcreate_u64(0)));
+		}
+
+		for (r = 0; r < 9; r++)
+			for (j = 0; j < GCM_BATCH; j++)
+				blk[j] = vaesmcq_u8(vaeseq_u8(blk[j], aes_rk[r]));
+
+		lo = mid = hi = vdupq_n_u64(0);
+		for (j = 0; j < GCM_BATCH; j++) {
+			blk[j] = veorq_u8(vaeseq_u8(blk[j], aes_rk[9]), aes_rk[10]);
+			blk[j] = veorq_u8(blk[j], vld1q_u8(buf + i + 16 * j));
+			c = vreinterpretq_u64_u8(bswap128(blk[j]));
+			if (j == 0)
+				c = veorq_u64(c, x);
+
+			h = gcm_h[GCM_BATCH - 1 - j];
+			lo = veorq_u64(lo, PMULL(c, h, 0, 0));
+			hi = veorq_u64(hi, PMULL(c, h, 1, 1));
+			mid = veorq_u64(mid, PMULL(c, h, 0, 1));
+			mid = veorq_u64(mid, PMULL(c, h, 1, 0));
+		}
+
+		x = ghash_reduce(lo, mid, hi);
+	}
+
+	return (vgetq_lane_u64(x, 0));
+}
+
+/*
+ * CRC-32C over three interleaved streams of CRC32C_CHUNK bytes each,
+ * hiding the latency of the crc32cx instruction.  The stream CRCs are
+ * combined with crc32c_shift_table().
+ */
+#define CRC32C_CHUNK	1024
+
+static unsigned crc32c_shift_chunk[4][256];
+static int crc32c_ready = 0;
+
+#define SHIFT_CHUNK(crc) (crc32c_shift_chunk[0][(crc) & 0xff] \
+	^ crc32c_shift_chunk[1][(crc) >> 8 & 0xff] \
+	^ crc32c_shift_chunk[2][(crc) >> 16 & 0xff] \
+	^ crc32c_shift_chunk[3][(crc) >> 24])
+
+__attribute__((target("+crc")))
+static unsigned long
+crc32c_crc(const unsigned char *buf, size_t len)
+{
+	uint64_t word;
+	uint32_t a = ~0U, b, c;
+	size_t i, j;
+
+	if (!crc32c_ready) {
+		crc32c_shift_table(crc32c_shift_chunk, CRC32C_CHUNK);
+		crc32c_ready = 1;
+	}
+
+	for (i = 0; i + 3 * CRC32C_CHUNK <= len; i += 3 * CRC32C_CHUNK) {
+		b = c = 0;
+		for (j = 0; j < CRC32C_CHUNK; j += 8) {
+			memcpy(&word, buf + i + j, sizeof(word));
+			a = __crc32cd(a, word);
+			memcpy(&word, buf + i + CRC32C_CHUNK + j, sizeof(word));
+			b = __crc32cd(b, word);
+			memcpy(&word, buf + i + 2 * CRC32C_CHUNK + j, sizeof(word));
+			c = __crc32cd(c, word);
+		}
+
+		a = SHIFT_CHUNK(a) ^ b;
+		a = SHIFT_CHUNK(a) ^ c;
+	}
+
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&word, buf + i, sizeof(word));
+		a = __crc32cd(a, word);
+	}
+
+	for (; i < len; i++)
+		a = __crc32cb(a, buf[i]);
+
+	return (~a);
+}
+
+/* SHA-256 using the SHA2 extension */
+__attribute__((target("+sha2")))
+static unsigned long
+sha256_sha2(const unsigned char *buf, size_t len)
+{
+	uint32x4_t abcd, efgh, save0, save1, tmp, wk, w[16];
+	size_t i;
+	int g;
+
+	abcd = vld1q_u32(&sha256_iv[0]);
+	efgh = vld1q_u32(&sha256_iv[4]);
+
+	for (i = 0; i + 64 <= len; i += 64) {
+		save0 = abcd;
+		save1 = efgh;
+
+		for (g = 0; g < 16; g++) {
+			if (g < 4)
+				w[g] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(buf + i + 16 * g)));
+			else
+				w[g] = vsha256su1q_u32(vsha256su0q_u32(w[g - 4], w[g - 3]),
+				    w[g - 2], w[g - 1]);
+
+			wk = vaddq_u32(w[g], vld1q_u32(&sha256_k[4 * g]));
+			tmp = abcd;
+			abcd = vsha256hq_u32(abcd, efgh, wk);
+			efgh = vsha256h2q_u32(efgh, tmp, wk);
+		}
+
+		abcd = vaddq_u32(abcd, save0);
+		efgh = vaddq_u32(efgh, save1);
+	}
+
+	return (vgetq_lane_u32(abcd, 0));
+}
+
+/*
+ * Fold the buffer into CLMUL_LANES 128 bit accumulators by carryless
+ * multiplication, as done by CRC implementations.
+ */
+__attribute__((target("+aes")))
+static unsigned long
+clmul_pmull(const unsigned char *buf, size_t len)
+{
+	uint64x2_t acc[CLMUL_LANES], k;
+	size_t i;
+	int j;
+
+	k = vcombine_u64(vcreate_u64(CLMUL_K_LO), vcreate_u64(CLMUL_K_HI));
+
+	for (j = 0; j < CLMUL_LANES; j++)
+		acc[j] = vdupq_n_u64(0);
+
+	for (i = 0; i + CLMUL_LANES * 16 <= len; i += CLMUL_LANES * 16)
+		for (j = 0; j < CLMUL_LANES; j++)
+			acc[j] = veorq_u64(
+			    veorq_u64(PMULL(acc[j], k, 0, 0), PMULL(acc[j], k, 1, 1)),
+			    vreinterpretq_u64_u8(vld1q_u8(buf + i + 16 * j)));
+
+	for (j = 1; j < CLMUL_LANES; j++)
+		acc[0] = veorq_u64(acc[0], acc[j]);
+
+	return (vgetq_lane_u64(acc[0], 0));
+}
+
+const struct kernel arch_kernels[] = {
+	"aes-gcm", "aes", "aes && pmull", aes_gcm_aes,
+	"crc32c", "crc32", "crc32", crc32c_crc,
+	"sha256", "sha2", "sha2", sha256_sha2,
+	"clmul", "pmull", "pmull", clmul_pmull,
+	NULL, NULL, NULL, NULL,
+};
@@ -0,0 +1,420 @@
+#include <sys/param.h>
+
+#include <immintrin.h>
+#include <string.h>
+
+#include "bench.h"
+
+/*
+ * Benchmark kernels using the amd64 crypto and checksum extensions.
+ * Each kernel is compiled for the extensions it needs using the
+ * target attribute and only run if the capability expression in
+ * arch_kernels[] holds.
+ */
+
+/*
+ * The time stamp counter ticks at a fixed reference frequency, not at
+ * the core clock, which turbo and power management vary.
+ */
+const char tick_unit[] = "TSC tick";
+
+unsigned long long
+read_ticks(void)
+{
+	unsigned lo, hi;
+
+	asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+
+	return ((unsigned long long)hi << 32 | lo);
+}
+
+/*
+ * AES-128-GCM encryption.  The ciphertext is computed in CTR mode
+ * and hashed with GHASH, aggregating the products of several blocks
+ * before reducing.  Trailing partial batches are ignored.
+ */
+static __m128i aes_rk[11], gcm_h[GCM_BATCH];	/* gcm_h[i] = H^(i+1) */
+static int gcm_ready = 0;
+
+#define BSWAP128 _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL)
+
+__attribute__((target("aes,sse4.1")))
+static __m128i
+aes_expand(__m128i key, __m128i gen)
+{
+	gen = _mm_shuffle_epi32(gen, 0xff);
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+	key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+
+	return (_mm_xor_si128(key, gen));
+}
+
+/*
+ * Reduce the 256 bit product lo ^ mid << 64 ^ hi << 128 of two
+ * byte-swapped field elements modulo the GHASH polynomial.  Always
+ * inlined so aes_gcm_vaes() gets VEX encoded code without paying for
+ * SSE/AVX transitions on each call.
+ */
+__attribute__((target("pclmul,sse4.1"), always_inline))
+static inline __m128i
+ghash_reduce(__m128i lo, __m128i mid, __m128i hi)
+{
+	__m128i t1, t2, t3;
+
+	lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+	hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+	/* the operands are bit-reflected: shift the product left by one */
+	t1 = _mm_srli_epi32(lo, 31);
+	t2 = _mm_srli_epi32(hi, 31);
+	lo = _mm_slli_epi32(lo, 1);
+	hi = _mm_slli_epi32(hi, 1);
+	t3 = _mm_srli_si128(t1, 12);
+	t2 = _mm_slli_si128(t2, 4);
+	t1 = _mm_slli_si128(t1, 4);
+	lo = _mm_or_si128(lo, t1);
+	hi = _mm_or_si128(hi, t2);
+	hi = _mm_or_si128(hi, t3);
+
+	/* reduce modulo x^128 + x^7 + x^2 + x + 1 */
+	t1 = _mm_slli_epi32(lo, 31);
+	t2 = _mm_slli_epi32(lo, 30);
+	t3 = _mm_slli_epi32(lo, 25);
+	t1 = _mm_xor_si128(t1, _mm_xor_si128(t2, t3));
+	t2 = _mm_srli_si128(t1, 4);
+	t1 = _mm_slli_si128(t1, 12);
+	lo = _mm_xor_si128(lo, t1);
+	t1 = _mm_srli_epi32(lo, 1);
+	t1 = _mm_xor_si128(t1, _mm_srli_epi32(lo, 2));
+	t1 = _mm_xor_si128(t1, _mm_srli_epi32(lo, 7));
+	t1 = _mm_xor_si128(t1, t2);
+	lo = _mm_xor_si128(lo, t1);
+
+	return (_mm_xor_si128(hi, lo));
+}
+
+__attribute__((target("pclmul,sse4.1")))
+static __m128i
+ghash_mul(__m128i a, __m128i b)
+{
+	__m128i mid;
+
+	mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10),
+	    _mm_clmulepi64_si128(a, b, 0x01));
+
+	return (ghash_reduce(_mm_clmulepi64_si128(a, b, 0x00), mid,
+	    _mm_clmulepi64_si128(a, b, 0x11)));
+}
+
+__attribute__((target("aes,pclmul,sse4.1")))
+static void
+gcm_init(void)
+{
+	__m128i h;
+	int i;
+
+	if (gcm_ready)
+		return;
+
+	aes_rk[0] = _mm_set_epi64x(0x0f0e0d0c0b0a0908ULL, 0x0706050403020100ULL);
+#define EXPAND(i, rcon) \
+	aes_rk[i] = aes_expand(aes_rk[i - 1], _mm_aeskeygenassist_si128(aes_rk[i - 1], rcon))
+	EXPAND(1, 0x01);
+	EXPAND(2, 0x02);
+	EXPAND(3, 0x04);
+	EXPAND(4, 0x08);
+	EXPAND(5, 0x10);
+	EXPAND(6, 0x20);
+	EXPAND(7, 0x40);
+	EXPAND(8, 0x80);
+	EXPAND(9, 0x1b);
+	EXPAND(10, 0x36);
+#undef EXPAND
+
+	/* H = AES_K(0) */
+	h = _mm_xor_si128(_mm_setzero_si128(), aes_rk[0]);
+	for (i = 1; i < 10; i++)
+		h = _mm_aesenc_si128(h, aes_rk[i]);
+
+	h = _mm_aesenclast_si128(h, aes_rk[10]);
+	gcm_h[0] = _mm_shuffle_epi8(h, BSWAP128);
+	for (i = 1; i < GCM_BATCH; i++)
+		gcm_h[i] = ghash_mul(gcm_h[i - 1], gcm_h[0]);
+
+	gcm_ready = 1;
+}
+
+__attribute__((target("aes,pclmul,sse4.1")))
+static unsigned long
+aes_gcm_aesni(const unsigned char *buf, size_t len)
+{
+	__m128i ctr, blk[GCM_BATCH], x, lo, mid, hi, c, h;
+	size_t i;
+	int j, r;
+
+	gcm_init();
+
+	ctr = _mm_set_epi64x(0, 2);
+	x = _mm_setzero_si128();
+
+	for (i = 0; i + GCM_BATCH * 16 <= len; i += GCM_BATCH * 16) {
+		for (j = 0; j < GCM_BATCH; j++) {
+			blk[j] = _mm_shuffle_epi8(ctr, BSWAP128);
+			blk[j] = _mm_xor_si128(blk[j], aes_rk[0]);
+			ctr = _mm_add_epi64(ctr, _mm_set_epi64x(0, 1));
+		}
+
+		for (r = 1; r < 10; r++)
+			for (j = 0; j < GCM_BATCH; j++)
+				blk[j] = _mm_aesenc_si128(blk[j], aes_rk[r]);
+
+		lo = mid = hi = _mm_setzero_si128();
+		for (j = 0; j < GCM_BATCH; j++) {
+			c = _mm_aesenclast_si128(blk[j], aes_rk[10]);
+			c = _mm_xor_si128(c, _mm_loadu_si128((const __m128i *)(buf + i + 16 * j)));
+			c = _mm_shuffle_epi8(c, BSWAP128);
+			if (j == 0)
+				c = _mm_xor_si128(c, x);
+
+			h = gcm_h[GCM_BATCH - 1 - j];
+			lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(c, h, 0x00));
+			hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(c, h, 0x11));
+			mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(c, h, 0x10));
+			mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(c, h, 0x01));
+		}
+
+		x = ghash_reduce(lo, mid, hi);
+	}
+
+	return (_mm_cvtsi128_si64(x));
+}
+
+/* same as aes_gcm_aesni, but two blocks per 256 bit register */
+__attribute__((target("vaes,vpclmulqdq,avx2,aes,pclmul,sse4.1")))
+static unsigned long
+aes_gcm_vaes(const unsigned char *buf, size_t len)
+{
+	__m256i ctr, rk[11], hpow[GCM_BATCH / 2], blk[GCM_BATCH / 2], bswap, c;
+	__m256i lo, mid, hi;
+	__m128i x;
+	size_t i;
+	int j, r;
+
+	gcm_init();
+
+	for (r = 0; r < 11; r++)
+		rk[r] = _mm256_broadcastsi128_si256(aes_rk[r]);
+
+	/* the first block of a pair is multiplied with the higher power */
+	for (j = 0; j < GCM_BATCH / 2; j++)
+		hpow[j] = _mm256_setr_m128i(gcm_h[GCM_BATCH - 1 - 2 * j],
+		    gcm_h[GCM_BATCH - 2 - 2 * j]);
+
+	bswap = _mm256_broadcastsi128_si256(BSWAP128);
+	ctr = _mm256_setr_epi64x(2, 0, 3, 0);
+	x = _mm_setzero_si128();
+
+	for (i = 0; i + GCM_BATCH * 16 <= len; i += GCM_BATCH * 16) {
+		for (j = 0; j < GCM_BATCH / 2; j++) {
+			blk[j] = _mm256_shuffle_epi8(ctr, bswap);
+			blk[j] = _mm256_xor_si256(blk[j], rk[0]);
+			ctr = _mm256_add_epi64(ctr, _mm256_setr_epi64x(2, 0, 2, 0));
+		}
+
+		for (r = 1; r < 10; r++)
+			for (j = 0; j < GCM_BATCH / 2; j++)
+				blk[j] = _mm256_aesenc_epi128(blk[j], rk[r]);
+
+		lo = mid = hi = _mm256_setzero_si256();
+		for (j = 0; j < GCM_BATCH / 2; j++) {
+			c = _mm256_aesenclast_epi128(blk[j], rk[10]);
+			c = _mm256_xor_si256(c, _mm256_loadu_si256((const __m256i *)(buf + i + 32 * j)));
+			c = _mm256_shuffle_epi8(c, bswap);
+			if (j == 0)
+				c = _mm256_xor_si256(c, _mm256_zextsi128_si256(x));
+
+			lo = _mm256_xor_si256(lo, _mm256_clmulepi64_epi128(c, hpow[j], 0x00));
+			hi = _mm256_xor_si256(hi, _mm256_clmulepi64_epi128(c, hpow[j], 0x11));
+			mid = _mm256_xor_si256(mid, _mm256_clmulepi64_epi128(c, hpow[j], 0x10));
+			mid = _mm256_xor_si256(mid, _mm256_clmulepi64_epi128(c, hpow[j], 0x01));
+		}
+
+		x = ghash_reduce(
+		    _mm_xor_si128(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1)),
+		    _mm_xor_si128(_mm256_castsi256_si128(mid), _mm256_extracti128_si256(mid, 1)),
+		    _mm_xor_si128(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1)));
+	}
+
+	return (_mm_cvtsi128_si64(x));
+}
+
+/*
+ * CRC-32C over three interleaved streams of CRC32C_CHUNK bytes each,
+ * hiding the latency of the crc32 instruction.  The stream CRCs are
+ * combined with crc32c_shift_table().
+ */
+#define CRC32C_CHUNK	1024
+
+static unsigned crc32c_shift_chunk[4][256];
+static int crc32c_ready = 0;
+
+#define SHIFT_CHUNK(crc) (crc32c_shift_chunk[0][(crc) & 0xff] \
+	^ crc32c_shift_chunk[1][(crc) >> 8 & 0xff] \
+	^ crc32c_shift_chunk[2][(crc) >> 16 & 0xff] \
+	^ crc32c_shift_chunk[3][(crc) >> 24])
+
+__attribute__((target("sse4.2")))
+static unsigned long
+crc32c_sse4_2(const unsigned char *buf, size_t len)
+{
+	unsigned long long a = ~0U, b, c, word;
+	size_t i, j;
+
+	if (!crc32c_ready) {
+		crc32c_shift_table(crc32c_shift_chunk, CRC32C_CHUNK);
+		crc32c_ready = 1;
+	}
+
+	for (i = 0; i + 3 * CRC32C_CHUNK <= len; i += 3 * CRC32C_CHUNK) {
+		b = c = 0;
+		for (j = 0; j < CRC32C_CHUNK; j += 8) {
+			memcpy(&word, buf + i + j, sizeof(word));
+			a = _mm_crc32_u64(a, word);
+			memcpy(&word, buf + i + CRC32C_CHUNK + j, sizeof(word));
+			b = _mm_crc32_u64(b, word);
+			memcpy(&word, buf + i + 2 * CRC32C_CHUNK + j, sizeof(word));
+			c = _mm_crc32_u64(c, word);
+		}
+
+		a = SHIFT_CHUNK(a) ^ b;
+		a = SHIFT_CHUNK(a) ^ c;
+	}
+
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&word, buf + i, sizeof(word));
+		a = _mm_crc32_u64(a, word);
+	}
+
+	for (; i < len; i++)
+		a = _mm_crc32_u8(a, buf[i]);
+
+	return (~a & 0xffffffffU);
+}
+
+/* SHA-256 using the SHA extensions */
+__attribute__((target("sha,sse4.1")))
+static unsigned long
+sha256_sha_ni(const unsigned char *buf, size_t len)
+{
+	__m128i state0, state1, save0, save1, tmp, msg, w[16];
+	const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	size_t i;
+	int g;
+
+	/* rearrange the state into the ABEF/CDGH layout */
+	tmp = _mm_loadu_si128((const __m128i *)&sha256_iv[0]);
+	state1 = _mm_loadu_si128((const __m128i *)&sha256_iv[4]);
+	tmp = _mm_shuffle_epi32(tmp, 0xb1);
+	state1 = _mm_shuffle_epi32(state1, 0x1b);
+	state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+	for (i = 0; i + 64 <= len; i += 64) {
+		save0 = state0;
+		save1 = state1;
+
+		for (g = 0; g < 16; g++) {
+			if (g < 4)
+				w[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(buf + i + 16 * g)), bswap);
+			else
+				w[g] = _mm_sha256msg2_epu32(_mm_add_epi32(
+				    _mm_sha256msg1_epu32(w[g - 4], w[g - 3]),
+				    _mm_alignr_epi8(w[g - 1], w[g - 2], 4)), w[g - 1]);
+
+			msg = _mm_add_epi32(w[g], _mm_loadu_si128((const __m128i *)&sha256_k[4 * g]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0e);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		}
+
+		state0 = _mm_add_epi32(state0, save0);
+		state1 = _mm_add_epi32(state1, save1);
+	}
+
+	/* back to ABCD/EFGH */
+	tmp = _mm_shuffle_epi32(state0, 0x1b);
+	state1 = _mm_shuffle_epi32(state1, 0xb1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+
+	return ((unsigned)_mm_cvtsi128_si32(state0));
+}
+
+/*
+ * Fold the buffer into CLMUL_LANES 128 bit accumulators by carryless
+ * multiplication, as done by CRC implementations.
+ */
+#define CLMUL_K _mm_set_epi64x(CLMUL_K_HI, CLMUL_K_LO)
+
+__attribute__((target("pclmul,sse4.1")))
+static unsigned long
+clmul_pclmulqdq(const unsigned char *buf, size_t len)
+{
+	__m128i acc[CLMUL_LANES], k = CLMUL_K;
+	size_t i;
+	int j;
+
+	for (j = 0; j < CLMUL_LANES; j++)
+		acc[j] = _mm_setzero_si128();
+
+	for (i = 0; i + CLMUL_LANES * 16 <= len; i += CLMUL_LANES * 16)
+		for (j = 0; j < CLMUL_LANES; j++)
+			acc[j] = _mm_xor_si128(
+			    _mm_xor_si128(_mm_clmulepi64_si128(acc[j], k, 0x00),
+			    _mm_clmulepi64_si128(acc[j], k, 0x11)),
+			    _mm_loadu_si128((const __m128i *)(buf + i + 16 * j)));
+
+	for (j = 1; j < CLMUL_LANES; j++)
+		acc[0] = _mm_xor_si128(acc[0], acc[j]);
+
+	return (_mm_cvtsi128_si64(acc[0]));
+}
+
+/* same as clmul_pclmulqdq, but two lanes per 256 bit register */
+__attribute__((target("vpclmulqdq,avx2")))
+static unsigned long
+clmul_vpclmulqdq(const unsigned char *buf, size_t len)
+{
+	__m256i acc[CLMUL_LANES / 2], k = _mm256_broadcastsi128_si256(CLMUL_K);
+	__m128i sum;
+	size_t i;
+	int j;
+
+	for (j = 0; j < CLMUL_LANES / 2; j++)
+		acc[j] = _mm256_setzero_si256();
+
+	for (i = 0; i + CLMUL_LANES * 16 <= len; i += CLMUL_LANES * 16)
+		for (j = 0; j < CLMUL_LANES / 2; j++)
+			acc[j] = _mm256_xor_si256(
+			    _mm256_xor_si256(_mm256_clmulepi64_epi128(acc[j], k, 0x00),
+			    _mm256_clmulepi64_epi128(acc[j], k, 0x11)),
+			    _mm256_loadu_si256((const __m256i *)(buf + i + 32 * j)));
+
+	for (j = 1; j < CLMUL_LANES / 2; j++)
+		acc[0] = _mm256_xor_si256(acc[0], acc[j]);
+
+	sum = _mm_xor_si128(_mm256_castsi256_si128(acc[0]),
+	    _mm256_extracti128_si256(acc[0], 1));
+
+	return (_mm_cvtsi128_si64(sum));
+}
+
+const struct kernel arch_kernels[] = {
+	"aes-gcm", "aesni", "aes && pclmulqdq && sse4_1", aes_gcm_aesni,
+	"aes-gcm", "vaes", "vaes && vpclmulqdq && avx2 && aes && pclmulqdq && sse4_1", aes_gcm_vaes,
+	"crc32c", "sse4_2", "sse4_2", crc32c_sse4_2,
+	"sha256", "sha_ni", "sha_ni && sse4_1", sha256_sha_ni,
+	"clmul", "pclmulqdq", "pclmulqdq && sse4_1", clmul_pclmulqdq,
+	"clmul", "vpclmulqdq", "vpclmulqdq && avx2", clmul_vpclmulqdq,
+	NULL, NULL, NULL, NULL,
+};
@@ -0,0 +1,16 @@
+#include <stddef.h>
+
+#include "bench.h"
+
+/* no architecture specific kernels, only the portable ones in bench.c */
+const struct kernel arch_kernels[] = {
+	NULL, NULL, NULL, NULL,
+};
+
+const char tick_unit[] = "";
+
+unsigned long long
+read_ticks(void)
+{
+	return (0);
+}
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Generate capnames.c, the sorted names of the capabilities of all
+# architectures, from the tables of the given hwcap_$arch.c files.
+# usage: capnames.sh hwcap_$arch.c ...
+
+cat <<EOF
+/* generated by capnames.sh from the hwcap_\$arch.c tables, do not edit */
+#include <stddef.h>
+
+#include "hwcap.h"
+
+const char *const capnames[] = {
+EOF
+
+awk '
+	/^} (caps|idcaps|cores|uarchs)\[\] = \{$/ { table = 1; next }
+	/^};$/ { table = 0 }
+	table && /^[ \t]+"[^"]+",/ {
+		split($0, field, "\"")
+		print field[2]
+	}' "$@" | LC_ALL=C sort -u | sed 's/.*/	"&",/'
+
+cat <<EOF
+};
+
+const size_t ncapnames = sizeof(capnames) / sizeof(capnames[0]);
+EOF
@@ -1,16 +1,28 @@
+#include <sys/param.h>
+#include <sys/auxv.h>
+#include <sys/cpuset.h>
+#include <sys/mman.h>
+#include <sys/sysctl.h>
+
 #include <assert.h>
+#include <ctype.h>
 #include <err.h>
 #include <errno.h>
 #include <libgen.h>
+#include <pthread.h>
+#include <pthread_np.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sysexits.h>
 #include <unistd.h>
 
+#include "bench.h"
 #include "hwcap.h"
 
-static char **wanted_caps;
+char **wanted_caps;
+int all_cores = 0;
+enum cc target_cc = CC_ANY;
 
 const struct cap *supported_caps[MAXCAPS];
 size_t ncaps = 0;
@@ -54,6 +66,250 @@ register_cap(const struct cap *cap)
 	supported_caps[ncaps++] = cap;
 }
 
+/*
+ * Recorded inputs for the replay capability source (-r).  Each line
+ * of a replay file holds a key followed by up to MAXVALS numbers.
+ * Empty lines and lines starting with # are ignored.  The records
+ * are produced by dump_inputs() (-D).
+ */
+#define MAXRECORDS 256
+#define MAXVALS 8
+static struct record {
+	char key[32];
+	size_t nval;
+	unsigned long val[MAXVALS];
+} records[MAXRECORDS];
+static size_t nrecords;
+
+int replaying = 0;
+
+static void
+load_replay(const char *path)
+{
+	FILE *f;
+	struct record *rec;
+	size_t linecap = 0, lineno = 0;
+	char *line = NULL, *p, *tok, *end;
+
+	if (strcmp(path, "-") == 0)
+		f = stdin;
+	else
+		f = fopen(path, "r");
+
+	if (f == NULL)
+		err(EX_NOINPUT, "%s", path);
+
+	while (getline(&line, &linecap, f) > 0) {
+		lineno++;
+
+		p = line;
+		do
+			tok = strsep(&p, " \t\n");
+		while (tok != NULL && *tok == '\0');
+
+		if (tok == NULL || *tok == '#')
+			continue;
+
+		if (nrecords >= MAXRECORDS)
+			errx(EX_DATAERR, "%s:%zu: too many records", path, lineno);
+
+		rec = records + nrecords++;
+		if (strlcpy(rec->key, tok, sizeof(rec->key)) >= sizeof(rec->key))
+			errx(EX_DATAERR, "%s:%zu: key too long: %s", path, lineno, tok);
+
+		rec->nval = 0;
+		while (tok = strsep(&p, " \t\n"), tok != NULL) {
+			if (*tok == '\0')
+				continue;
+
+			if (rec->nval >= MAXVALS)
+				errx(EX_DATAERR, "%s:%zu: too many values", path, lineno);
+
+			errno = 0;
+			rec->val[rec->nval++] = strtoul(tok, &end, 0);
+			if (errno != 0 || *end != '\0')
+				errx(EX_DATAERR, "%s:%zu: invalid number: %s", path, lineno, tok);
+		}
+	}
+
+	if (ferror(f))
+		err(EX_IOERR, "%s", path);
+
+	if (f != stdin)
+		fclose(f);
+
+	free(line);
+	replaying = 1;
+}
+
+/*
+ * Find the replay record with the given key whose first nindex values
+ * equal index.  Copy the values following the index to val, filling
+ * up with zeroes to nval values.  Return 1 if such a record was found
+ * and 0 otherwise, in which case val is set to all zeroes.
+ */
+int
+replay_lookup(const char *key, const unsigned long *index, size_t nindex,
+    unsigned long *val, size_t nval)
+{
+	size_t i, j;
+
+	memset(val, 0, nval * sizeof(*val));
+
+	for (i = 0; i < nrecords; i++) {
+		if (strcmp(key, records[i].key) != 0 || records[i].nval < nindex)
+			continue;
+
+		for (j = 0; j < nindex; j++)
+			if (records[i].val[j] != index[j])
+				goto next_record;
+
+		for (j = 0; j < nval && nindex + j < records[i].nval; j++)
+			val[j] = records[i].val[nindex + j];
+
+		return (1);
+
+	next_record:
+		;
+	}
+
+	return (0);
+}
+
+/*
+ * Return the value of the elf auxiliary vector entry type, or of the
+ * replay record name when replaying.  Entries not present are 0.
+ */
+unsigned long
+get_auxv(int type, const char *name)
+{
+	unsigned long val = 0;
+	int status;
+
+	if (replaying) {
+		replay_lookup(name, NULL, 0, &val, 1);
+		return (val);
+	}
+
+	status = elf_aux_info(type, &val, sizeof(val));
+	if (status != 0 && errno != ENOENT)
+		err(EX_SOFTWARE, "elf_aux_info(%s)", name);
+
+	return (val);
+}
+
+struct cpu_job {
+	pthread_t thread;
+	unsigned long (*fn)(void);
+	unsigned long result;
+};
+
+static void *
+run_cpu_job(void *arg)
+{
+	struct cpu_job *job = arg;
+
+	job->result = job->fn();
+
+	return (NULL);
+}
+
+/*
+ * Run fn on every CPU available to the process.  One thread is pinned
+ * to each CPU and all threads run in parallel.  The value returned by
+ * fn on CPU i is stored in percpu[i].  CPUs not available are marked
+ * as NOCPU.
+ */
+void
+foreach_cpu(unsigned long (*fn)(void), unsigned long percpu[MAXCPUS])
+{
+	static struct cpu_job jobs[MAXCPUS];
+	pthread_attr_t attr;
+	cpuset_t avail, mask;
+	int i, error;
+
+	if (cpuset_getaffinity(CPU_LEVEL_CPUSET, CPU_WHICH_PID, -1,
+	    sizeof(avail), &avail) != 0)
+		err(EX_OSERR, "cpuset_getaffinity");
+
+	for (i = 0; i < MAXCPUS; i++) {
+		percpu[i] = NOCPU;
+		jobs[i].fn = NULL;
+
+		if (i >= CPU_SETSIZE || !CPU_ISSET(i, &avail))
+			continue;
+
+		CPU_ZERO(&mask);
+		CPU_SET(i, &mask);
+
+		error = pthread_attr_init(&attr);
+		if (error != 0)
+			errc(EX_OSERR, error, "pthread_attr_init");
+
+		error = pthread_attr_setaffinity_np(&attr, sizeof(mask), &mask);
+		if (error != 0)
+			errc(EX_OSERR, error, "pthread_attr_setaffinity_np");
+
+		jobs[i].fn = fn;
+		error = pthread_create(&jobs[i].thread, &attr, run_cpu_job, jobs + i);
+		if (error != 0)
+			errc(EX_OSERR, error, "pthread_create");
+
+		pthread_attr_destroy(&attr);
+	}
+
+	for (i = 0; i < MAXCPUS; i++) {
+		if (jobs[i].fn == NULL)
+			continue;
+
+		error = pthread_join(jobs[i].thread, NULL);
+		if (error != 0)
+			errc(EX_OSERR, error, "pthread_join");
+
+		percpu[i] = jobs[i].result;
+	}
+}
+
+/*
+ * Print label followed by the list of CPUs i with percpu[i] == value
+ * in the format understood by cpuset(1).  If there are no such CPUs,
+ * nothing is printed.
+ */
+void
+print_cpulist(const char *label, const unsigned long percpu[MAXCPUS],
+    unsigned long value)
+{
+	int i, first = -1, any = 0;
+
+	for (i = 0; i <= MAXCPUS; i++) {
+		if (i < MAXCPUS && percpu[i] == value) {
+			if (first < 0)
+				first = i;
+
+			continue;
+		}
+
+		if (first < 0)
+			continue;
+
+		if (any)
+			putchar(',');
+		else
+			printf("%-15s ", label);
+
+		if (first == i - 1)
+			printf("%d", first);
+		else
+			printf("%d-%d", first, i - 1);
+
+		first = -1;
+		any = 1;
+	}
+
+	if (any)
+		putchar('\n');
+}
+
 static void
 print_caps(void) {
 	size_t i;
@@ -85,6 +341,65 @@ print_archlevel(void) {
 		puts(get_archlevel()->name);
 }
 
+/* print a page size like 4K or 2M, preceded by a space */
+static void
+print_pagesize(size_t size)
+{
+	static const char units[] = "BKMGTPE";
+	size_t unit = 0;
+
+	while (size >= 1024 && size % 1024 == 0 && unit < sizeof(units) - 2) {
+		size /= 1024;
+		unit++;
+	}
+
+	printf(" %zu%c", size, units[unit]);
+}
+
+static void
+print_pagesize_line(const char *label, const size_t sizes[], size_t n)
+{
+	size_t i;
+
+	printf("%-15s", label);
+	for (i = 0; i < n; i++)
+		print_pagesize(sizes[i]);
+
+	putchar('\n');
+}
+
+static void
+print_pagesizes(void)
+{
+	size_t sizes[16], len, n, ngran;
+	int nos, enabled;
+
+	/* with several granules, the other sizes are blocks of the one in use */
+	ngran = get_granules(sizes, nitems(sizes));
+	if (ngran > 0)
+		print_pagesize_line("granules", sizes, ngran);
+
+	n = get_pagesizes(sizes, nitems(sizes));
+	if (n > 0)
+		print_pagesize_line(ngran > 0 ? "blocks" : "hardware", sizes, n);
+
+	/* these describe the host, not the machine replayed */
+	if (replaying)
+		return;
+
+	nos = getpagesizes(sizes, nitems(sizes));
+	if (nos < 0)
+		err(EX_OSERR, "getpagesizes");
+
+	print_pagesize_line("os", sizes, nos);
+
+	/* transparent superpage promotion; the name is machine dependent */
+	len = sizeof(enabled);
+	if (sysctlbyname("vm.pmap.pg_ps_enabled", &enabled, &len, NULL, 0) == 0
+	    || sysctlbyname("vm.pmap.superpages_enabled", &enabled, &len, NULL, 0) == 0)
+		printf("%-15s %s\n", "superpages", enabled ? "enabled" : "disabled");
+}
+
 static int
 all_caps_supported(char **args) {
 	size_t i, j;
@@ -103,12 +418,285 @@ all_caps_supported(char **args) {
 	return (1);
 }
 
+/*
+ * Capability expressions (-e).  Each expression is compiled once into
+ * a postfix program, with the capabilities looked up at compile time,
+ * and then evaluated on a stack of bits.
+ *
+ *	expr	= term { "||" term }
+ *	term	= factor { "&&" factor }
+ *	factor	= "!" factor | "(" expr ")" | capability
+ */
+#define MAXPROG 256
+#define MAXDEPTH 64
+enum {
+	OP_FALSE,
+	OP_TRUE,
+	OP_NOT,
+	OP_AND,
+	OP_OR,
+};
+
+struct expr {
+	const char *pos;		/* parser position */
+	int depth;			/* nesting depth */
+	size_t len;			/* program length */
+	unsigned char prog[MAXPROG];
+};
+
+static const char	*compile_expr(struct expr *);
+
+static int
+compare_capname(const void *name, const void *capname)
+{
+	return (strcmp(name, *(const char *const *)capname));
+}
+
+/* is name a capability of any architecture? */
+static int
+is_capname(const char *name)
+{
+	return (bsearch(name, capnames, ncapnames, sizeof(capnames[0]),
+	    compare_capname) != NULL);
+}
+
+static int
+is_capchar(int c)
+{
+	return (isalnum(c) || c == '_' || c == '.' || c == '-');
+}
+
+static const char *
+emit(struct expr *e, int op)
+{
+	if (e->len >= MAXPROG)
+		return ("expression too long");
+
+	e->prog[e->len++] = op;
+
+	return (NULL);
+}
+
+static void
+skip_space(struct expr *e)
+{
+	while (isspace((unsigned char)*e->pos))
+		e->pos++;
+}
+
+static const char *
+compile_factor(struct expr *e)
+{
+	const char *error;
+	char name[64];
+	size_t len;
+
+	skip_space(e);
+
+	if ((*e->pos == '!' || *e->pos == '(') && e->depth >= MAXDEPTH)
+		return ("expression nested too deeply");
+
+	if (*e->pos == '!') {
+		e->pos++;
+		e->depth++;
+		error = compile_factor(e);
+		e->depth--;
+		if (error != NULL)
+			return (error);
+
+		return (emit(e, OP_NOT));
+	}
+
+	if (*e->pos == '(') {
+		e->pos++;
+		e->depth++;
+		error = compile_expr(e);
+		e->depth--;
+		if (error != NULL)
+			return (error);
+
+		skip_space(e);
+		if (*e->pos != ')')
+			return ("expected )");
+
+		e->pos++;
+
+		return (NULL);
+	}
+
+	for (len = 0; is_capchar((unsigned char)e->pos[len]); len++)
+		;
+
+	if (len == 0)
+		return (*e->pos == '\0' ? "unexpected end of expression"
+		    : "expected capability");
+
+	if (len >= sizeof(name))
+		return ("capability name too long");
+
+	memcpy(name, e->pos, len);
+	name[len] = '\0';
+
+	/*
+	 * Capabilities of other architectures are false, so expressions
+	 * can be shared between them, but a misspelt name must not
+	 * silently evaluate to false.
+	 */
+	if (!is_capname(name))
+		return ("unknown capability");
+
+	e->pos += len;
+
+	return (emit(e, have_cap(name) != NULL ? OP_TRUE : OP_FALSE));
+}
+
+static const char *
+compile_term(struct expr *e)
+{
+	const char *error;
+
+	error = compile_factor(e);
+	while (error == NULL) {
+		skip_space(e);
+		if (strncmp(e->pos, "&&", 2) != 0)
+			break;
+
+		e->pos += 2;
+		error = compile_factor(e);
+		if (error == NULL)
+			error = emit(e, OP_AND);
+	}
+
+	return (error);
+}
+
+static const char *
+compile_expr(struct expr *e)
+{
+	const char *error;
+
+	error = compile_term(e);
+	while (error == NULL) {
+		skip_space(e);
+		if (strncmp(e->pos, "||", 2) != 0)
+			break;
+
+		e->pos += 2;
+		error = compile_term(e);
+		if (error == NULL)
+			error = emit(e, OP_OR);
+	}
+
+	return (error);
+}
+
+/*
+ * Compile and evaluate the expression str.  Return 0 or 1 for false
+ * and true, or -1 after printing a diagnostic if str is malformed or
+ * names an unknown capability.
+ */
+int
+eval_expr(const char *str)
+{
+	struct expr e;
+	const char *error;
+	size_t i, sp = 0;
+	unsigned char stack[MAXPROG];
+
+	e.pos = str;
+	e.depth = 0;
+	e.len = 0;
+
+	error = compile_expr(&e);
+	if (error == NULL) {
+		skip_space(&e);
+		if (*e.pos != '\0')
+			error = "unexpected character";
+	}
+
+	if (error != NULL) {
+		warnx("%s at offset %td: %s", error, e.pos - str, str);
+		return (-1);
+	}
+
+	for (i = 0; i < e.len; i++)
+		switch (e.prog[i]) {
+		case OP_FALSE: stack[sp++] = 0; break;
+		case OP_TRUE:  stack[sp++] = 1; break;
+		case OP_NOT:   stack[sp - 1] ^= 1; break;
+		case OP_AND:   sp--; stack[sp - 1] &= stack[sp]; break;
+		case OP_OR:    sp--; stack[sp - 1] |= stack[sp]; break;
+		}
+
+	assert(sp == 1);
+
+	return (stack[0]);
+}
+
+/*
+ * Evaluate each expression in args and return 1 if all are true.
+ * Without args, read expressions from stdin, one per line, and write
+ * true, false, or error for each one to stdout.  Return -1 on any
+ * malformed expression.
+ */
+static int
+all_exprs_true(char **args)
+{
+	size_t i, linecap = 0;
+	ssize_t len;
+	char *line = NULL;
+	int res, all = 1;
+
+	if (args[0] != NULL) {
+		for (i = 0; args[i] != NULL; i++) {
+			res = eval_expr(args[i]);
+			if (res < 0)
+				return (-1);
+
+			all &= res;
+		}
+
+		return (all);
+	}
+
+	while (len = getline(&line, &linecap, stdin), len > 0) {
+		if (line[len - 1] == '\n')
+			line[len - 1] = '\0';
+
+		res = eval_expr(line);
+		if (res < 0) {
+			puts("error");
+			all = -1;
+		} else {
+			puts(res ? "true" : "false");
+			if (all >= 0)
+				all &= res;
+		}
+
+		/* we may be talking to a coprocess */
+		fflush(stdout);
+	}
+
+	if (ferror(stdin))
+		err(EX_IOERR, "stdin");
+
+	free(line);
+
+	return (all);
+}
+
 static enum {
 	MODE_FLAGS,   /* -f */
 	MODE_VERBOSE, /* -v */
 	MODE_QUERY,   /* -q */
 	MODE_CFLAGS,  /* -c */
 	MODE_LEVEL,   /* -l */
+	MODE_CORETYPES, /* -T */
+	MODE_PMU,     /* -P */
+	MODE_DUMP,    /* -D */
+	MODE_EXPR,    /* -e */
+	MODE_PAGESIZES, /* -p */
+	MODE_BENCH,   /* -b */
 } mode;
 
 static enum {
@@ -116,34 +704,63 @@ static enum {
 	SOURCE_HWCAP,   /* -h */
 	SOURCE_CPUID,   /* -i */
 	SOURCE_ALL,    /* -a */
+	SOURCE_REPLAY, /* -r */
 //	SOURCE_ISA,     /* -m */
 } source;
 
 int main(int argc, char *argv[]) {
+	const char *replay_file = NULL;
 	int opt;
 
-	while (opt = getopt(argc, argv, "fvqclhia"), opt != -1)
+	while (opt = getopt(argc, argv, "fvqclepbTPDC:hiar:"), opt != -1)
 		switch (opt) {
 		case 'f': mode = MODE_FLAGS;   break;
 		case 'v': mode = MODE_VERBOSE; break;
 		case 'q': mode = MODE_QUERY;   break;
 		case 'c': mode = MODE_CFLAGS;  break;
 		case 'l': mode = MODE_LEVEL;   break;
+		case 'e': mode = MODE_EXPR;    break;
+		case 'p': mode = MODE_PAGESIZES; break;
+		case 'b': mode = MODE_BENCH;   break;
+		case 'T': mode = MODE_CORETYPES; break;
+		case 'P': mode = MODE_PMU;     break;
+		case 'D': mode = MODE_DUMP;    break;
+		case 'C':
+			if (strcmp(optarg, "clang") == 0)
+				target_cc = CC_CLANG;
+			else if (strcmp(optarg, "gcc") == 0)
+				target_cc = CC_GCC;
+			else
+				errx(EX_USAGE, "unknown compiler: %s", optarg);
+
+			break;
 
 		case 'h': source = SOURCE_HWCAP; break;
 		case 'i': source = SOURCE_CPUID; break;
 		case 'a': source = SOURCE_ALL;  break;
+		case 'r': source = SOURCE_REPLAY; replay_file = optarg; break;
 //		case 'm': source = SOURCE_ISA;   break;
 		case '?':
 		default:
-			fprintf(stderr, "usage: %s (-fvqcl) (-hiam) [cap...]\n",
-			    basename(argv[0]));
+			fprintf(stderr, "usage: %s (-fvqclepbDPT) [-C compiler] "
+			    "(-hiam | -r file) [cap...]\n", basename(argv[0]));
 			return (EX_USAGE);
 		}
 
-	if (optind < argc)
+	/*
+	 * expressions need all capabilities to be evaluated,
+	 * benchmarks take primitive names as arguments
+	 */
+	if (optind < argc && mode != MODE_EXPR && mode != MODE_BENCH)
 		wanted_caps = argv + optind;
 
+	/* -mtune combines the cores of all CPUs, elsewhere ours is enough */
+	all_cores = mode == MODE_CFLAGS;
+
+	/* benchmarks must only use instructions the hardware has */
+	if (mode == MODE_BENCH && source != SOURCE_DEFAULT && source != SOURCE_HWCAP)
+		errx(EX_USAGE, "-b requires the default capability source");
+
 	if (source == SOURCE_DEFAULT)
 		/* machine dependent */
 		source = SOURCE_HWCAP;
@@ -152,17 +769,35 @@ int main(int argc, char *argv[]) {
 	case SOURCE_HWCAP: caps_from_auxv(); break;
 //	case SOURCE_CPUID: caps_from_cpuid(); break;
 	case SOURCE_ALL:   caps_all(); break;
+	case SOURCE_REPLAY:
+		load_replay(replay_file);
+		caps_from_auxv();
+		break;
 //	case SOURCE_ISA:   caps_from_isa(); break;
 	}
 	
 	switch (mode) {
 	case MODE_FLAGS:   print_caps(); break;
 	case MODE_VERBOSE: print_caps_verbose(); break;
-	case MODE_CFLAGS:  print_cflags(); break;
 	case MODE_LEVEL:   print_archlevel(); break;
+	case MODE_CORETYPES: print_coretypes(); break;
+	case MODE_PMU:     print_pmu(); break;
+	case MODE_DUMP:    dump_inputs(); break;
+	case MODE_PAGESIZES: print_pagesizes(); break;
+	case MODE_BENCH:   run_benchmarks(argv + optind); break;
+	case MODE_CFLAGS:
+		/* no options to give for the capabilities wanted */
+		return (print_cflags() && all_caps_supported(argv + optind)
+		    ? EXIT_SUCCESS : EXIT_FAILURE);
 	case MODE_QUERY:
 		return (all_caps_supported(argv + optind)
 		    ? EXIT_SUCCESS : EXIT_FAILURE);
+	case MODE_EXPR:
+		switch (all_exprs_true(argv + optind)) {
+		case 0:  return (EXIT_FAILURE);
+		case 1:  return (EXIT_SUCCESS);
+		default: return (EX_DATAERR);
+		}
 	}
 
 	return (EXIT_SUCCESS);
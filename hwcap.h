@@ -1,3 +1,6 @@
+#ifndef HWCAP_H
+#define HWCAP_H
+
 struct cap {
 	const char *name, *cflag, *descr;
 };
@@ -9,9 +12,35 @@ const struct cap	*have_cap(const char *);
 #define MAXCAPS 1000
 extern	const struct cap 	*supported_caps[MAXCAPS];
 extern	size_t			 ncaps;
+extern	char			**wanted_caps;	/* NULL for all */
+extern	int			 all_cores;	/* cores of all CPUs, not just ours */
+
+/* compiler -c prints options for (-C) */
+extern	enum cc { CC_ANY, CC_CLANG, CC_GCC }	target_cc;
+
+#define MAXCPUS 1024
+#define NOCPU	(~0UL)
+void	foreach_cpu(unsigned long (*)(void), unsigned long [MAXCPUS]);
+void	print_cpulist(const char *, const unsigned long [MAXCPUS], unsigned long);
+
+extern	int	replaying;
+int	replay_lookup(const char *, const unsigned long *, size_t, unsigned long *, size_t);
+unsigned long	get_auxv(int, const char *);
+int	eval_expr(const char *);
+
+/* provided by capnames.c, generated by capnames.sh */
+extern	const char *const	capnames[];
+extern	const size_t		ncapnames;
 
 /* provided by hwcap_$arch.c */
 void	caps_from_auxv(void);
 void	caps_all(void);
-void	print_cflags(void);
+int	print_cflags(void);
+void	print_coretypes(void);
+void	print_pmu(void);
+void	dump_inputs(void);
+size_t	get_pagesizes(size_t [], size_t);
+size_t	get_granules(size_t [], size_t);
 const struct cap 	*get_archlevel(void);
+
+#endif /* HWCAP_H */
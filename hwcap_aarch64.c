@@ -1,11 +1,28 @@
-#include <err.h>
-#include <errno.h>
+#include <sys/param.h>
+
 #include <stdio.h>
 #include <string.h>
 #include <sys/auxv.h>
-#include <sysexits.h>
+#include <unistd.h>
 
 #include "hwcap.h"
+#include "hwcap_resolve.h"
+#include "resolve.h"
+
+/*
+ * Synthesized from ID registers read through HWCAP_CPUID emulation,
+ * see read_idregs().  PMU versions are cumulative.
+ */
+#define IDREG_PMUV3	0x00000001UL	/* ID_AA64DFR0_EL1.PMUVer >= 1 */
+#define IDREG_PMUV3P1	0x00000002UL	/* ID_AA64DFR0_EL1.PMUVer >= 4 */
+#define IDREG_PMUV3P4	0x00000004UL	/* ID_AA64DFR0_EL1.PMUVer >= 5 */
+#define IDREG_PMUV3P5	0x00000008UL	/* ID_AA64DFR0_EL1.PMUVer >= 6 */
+#define IDREG_PMUV3P7	0x00000010UL	/* ID_AA64DFR0_EL1.PMUVer >= 7 */
+#define IDREG_PMUV3P8	0x00000020UL	/* ID_AA64DFR0_EL1.PMUVer >= 8 */
+#define IDREG_PMUV3P9	0x00000040UL	/* ID_AA64DFR0_EL1.PMUVer >= 9 */
+#define IDREG_TGRAN4	0x00000080UL	/* ID_AA64MMFR0_EL1.TGran4 != 0xf */
+#define IDREG_TGRAN16	0x00000100UL	/* ID_AA64MMFR0_EL1.TGran16 != 0 */
+#define IDREG_TGRAN64	0x00000200UL	/* ID_AA64MMFR0_EL1.TGran64 != 0xf */
 
 /* https://docs.kernel.org/arch/arm64/elf_hwcaps.html */
 static const struct hwcap {
@@ -164,25 +181,291 @@ static const struct hwcap {
 	NULL, NULL, NULL, 0, 0,
 };
 
+#ifndef LIBHWCAP
+/*
+ * Capabilities derived from ID registers.  These never have a cflag
+ * as print_cflags() treats all capabilities as entries of caps[].
+ */
+static const struct idcap {
+	struct cap cap;
+	unsigned long	idregs;
+} idcaps[] = {
+	"pmuv3",      "",          "performance monitors extension",                IDREG_PMUV3,
+	"pmuv3p1",    "",          "performance monitors extension 3.1",            IDREG_PMUV3P1,
+	"pmuv3p4",    "",          "performance monitors extension 3.4",            IDREG_PMUV3P4,
+	"pmuv3p5",    "",          "performance monitors extension 3.5 (64-bit counters)", IDREG_PMUV3P5,
+	"pmuv3p7",    "",          "performance monitors extension 3.7",            IDREG_PMUV3P7,
+	"pmuv3p8",    "",          "performance monitors extension 3.8",            IDREG_PMUV3P8,
+	"pmuv3p9",    "",          "performance monitors extension 3.9",            IDREG_PMUV3P9,
+	"tgran4",     "",          "4K translation granule",                        IDREG_TGRAN4,
+	"tgran16",    "",          "16K translation granule",                       IDREG_TGRAN16,
+	"tgran64",    "",          "64K translation granule",                       IDREG_TGRAN64,
+	NULL, NULL, NULL, 0,
+};
+
+/*
+ * Cores by MIDR_EL1 implementer and part number.  The cflag is the
+ * name understood by the -mcpu and -mtune options of cc(1).  The tier
+ * orders cores of heterogeneous systems by performance.
+ */
+#define LITTLE	0
+#define BIG	1
+#define PRIME	2
+
+static const struct core {
+	struct cap cap;
+	unsigned int implementer, part, tier;
+} cores[] = {
+	/* Arm */
+	"cortex-a34",  "cortex-a34",  "Arm Cortex-A34",      0x41, 0xd02, LITTLE,
+	"cortex-a53",  "cortex-a53",  "Arm Cortex-A53",      0x41, 0xd03, LITTLE,
+	"cortex-a35",  "cortex-a35",  "Arm Cortex-A35",      0x41, 0xd04, LITTLE,
+	"cortex-a55",  "cortex-a55",  "Arm Cortex-A55",      0x41, 0xd05, LITTLE,
+	"cortex-a65",  "cortex-a65",  "Arm Cortex-A65",      0x41, 0xd06, LITTLE,
+	"cortex-a57",  "cortex-a57",  "Arm Cortex-A57",      0x41, 0xd07, BIG,
+	"cortex-a72",  "cortex-a72",  "Arm Cortex-A72",      0x41, 0xd08, BIG,
+	"cortex-a73",  "cortex-a73",  "Arm Cortex-A73",      0x41, 0xd09, BIG,
+	"cortex-a75",  "cortex-a75",  "Arm Cortex-A75",      0x41, 0xd0a, BIG,
+	"cortex-a76",  "cortex-a76",  "Arm Cortex-A76",      0x41, 0xd0b, BIG,
+	"neoverse-n1", "neoverse-n1", "Arm Neoverse N1",     0x41, 0xd0c, BIG,
+	"cortex-a77",  "cortex-a77",  "Arm Cortex-A77",      0x41, 0xd0d, BIG,
+	"cortex-a76ae", "cortex-a76ae", "Arm Cortex-A76AE",  0x41, 0xd0e, BIG,
+	"neoverse-v1", "neoverse-v1", "Arm Neoverse V1",     0x41, 0xd40, BIG,
+	"cortex-a78",  "cortex-a78",  "Arm Cortex-A78",      0x41, 0xd41, BIG,
+	"cortex-a78ae", "cortex-a78ae", "Arm Cortex-A78AE",  0x41, 0xd42, BIG,
+	"cortex-a65ae", "cortex-a65ae", "Arm Cortex-A65AE",  0x41, 0xd43, LITTLE,
+	"cortex-x1",   "cortex-x1",   "Arm Cortex-X1",       0x41, 0xd44, PRIME,
+	"cortex-a510", "cortex-a510", "Arm Cortex-A510",     0x41, 0xd46, LITTLE,
+	"cortex-a710", "cortex-a710", "Arm Cortex-A710",     0x41, 0xd47, BIG,
+	"cortex-x2",   "cortex-x2",   "Arm Cortex-X2",       0x41, 0xd48, PRIME,
+	"neoverse-n2", "neoverse-n2", "Arm Neoverse N2",     0x41, 0xd49, BIG,
+	"neoverse-e1", "neoverse-e1", "Arm Neoverse E1",     0x41, 0xd4a, LITTLE,
+	"cortex-a78c", "cortex-a78c", "Arm Cortex-A78C",     0x41, 0xd4b, BIG,
+	"cortex-x1c",  "cortex-x1c",  "Arm Cortex-X1C",      0x41, 0xd4c, PRIME,
+	"cortex-a715", "cortex-a715", "Arm Cortex-A715",     0x41, 0xd4d, BIG,
+	"cortex-x3",   "cortex-x3",   "Arm Cortex-X3",       0x41, 0xd4e, PRIME,
+	"neoverse-v2", "neoverse-v2", "Arm Neoverse V2",     0x41, 0xd4f, BIG,
+	"cortex-a520", "cortex-a520", "Arm Cortex-A520",     0x41, 0xd80, LITTLE,
+	"cortex-a720", "cortex-a720", "Arm Cortex-A720",     0x41, 0xd81, BIG,
+	"cortex-x4",   "cortex-x4",   "Arm Cortex-X4",       0x41, 0xd82, PRIME,
+	"neoverse-v3", "neoverse-v3", "Arm Neoverse V3",     0x41, 0xd84, BIG,
+	"cortex-x925", "cortex-x925", "Arm Cortex-X925",     0x41, 0xd85, PRIME,
+	"cortex-a725", "cortex-a725", "Arm Cortex-A725",     0x41, 0xd87, BIG,
+	"neoverse-n3", "neoverse-n3", "Arm Neoverse N3",     0x41, 0xd8e, BIG,
+
+	/* Broadcom */
+	"vulcan",      "thunderx2t99", "Broadcom Vulcan",    0x42, 0x516, BIG,
+
+	/* Cavium */
+	"thunderxt88", "thunderxt88", "Cavium ThunderX T88", 0x43, 0x0a1, BIG,
+	"thunderxt81", "thunderxt81", "Cavium ThunderX T81", 0x43, 0x0a2, BIG,
+	"thunderxt83", "thunderxt83", "Cavium ThunderX T83", 0x43, 0x0a3, BIG,
+	"thunderx2t99", "thunderx2t99", "Cavium ThunderX2",  0x43, 0x0af, BIG,
+	"thunderx3t110", "thunderx3t110", "Marvell ThunderX3", 0x43, 0x0b8, BIG,
+
+	/* Fujitsu */
+	"a64fx",       "a64fx",       "Fujitsu A64FX",       0x46, 0x001, BIG,
+
+	/* HiSilicon */
+	"tsv110",      "tsv110",      "HiSilicon TaiShan v110", 0x48, 0xd01, BIG,
+
+	/* NVIDIA */
+	"carmel",      "carmel",      "NVIDIA Carmel",       0x4e, 0x004, BIG,
+
+	/* Applied Micro */
+	"xgene1",      "xgene1",      "Applied Micro X-Gene 1", 0x50, 0x000, BIG,
+
+	/* Qualcomm */
+	"falkor",      "falkor",      "Qualcomm Falkor",     0x51, 0xc00, BIG,
+	"saphira",     "saphira",     "Qualcomm Saphira",    0x51, 0xc01, BIG,
+
+	/* Apple */
+	"apple-icestorm", "apple-m1", "Apple M1 efficiency core", 0x61, 0x022, LITTLE,
+	"apple-firestorm", "apple-m1", "Apple M1 performance core", 0x61, 0x023, BIG,
+	"apple-icestorm", "apple-m1", "Apple M1 Pro efficiency core", 0x61, 0x024, LITTLE,
+	"apple-firestorm", "apple-m1", "Apple M1 Pro performance core", 0x61, 0x025, BIG,
+	"apple-icestorm", "apple-m1", "Apple M1 Max efficiency core", 0x61, 0x028, LITTLE,
+	"apple-firestorm", "apple-m1", "Apple M1 Max performance core", 0x61, 0x029, BIG,
+	"apple-blizzard", "apple-m2", "Apple M2 efficiency core", 0x61, 0x032, LITTLE,
+	"apple-avalanche", "apple-m2", "Apple M2 performance core", 0x61, 0x033, BIG,
+
+	/* Ampere */
+	"ampere1",     "ampere1",     "Ampere AmpereOne",    0xc0, 0xac3, BIG,
+	"ampere1a",    "ampere1a",    "Ampere AmpereOne A",  0xc0, 0xac4, BIG,
+	"ampere1b",    "ampere1b",    "Ampere AmpereOne B",  0xc0, 0xac5, BIG,
+
+	NULL, NULL, NULL, 0, 0, 0,
+};
+
+/* big.LITTLE combinations understood by GCC's -mtune, big core first */
+static const char *const tune_pairs[][2] = {
+	"cortex-a57", "cortex-a53",
+	"cortex-a72", "cortex-a53",
+	"cortex-a73", "cortex-a35",
+	"cortex-a73", "cortex-a53",
+	"cortex-a75", "cortex-a55",
+	"cortex-a76", "cortex-a55",
+};
+
+#define read_idreg(reg) ({					\
+	unsigned long _val;					\
+	asm ("mrs %0, " #reg : "=r"(_val));			\
+	_val;							\
+})
+
+/* read an ID register, or its replay record when replaying */
+#define get_idreg(reg) (replaying ? replay_idreg(#reg) : read_idreg(reg))
+
+static unsigned long
+replay_idreg(const char *name)
+{
+	unsigned long val;
+
+	replay_lookup(name, NULL, 0, &val, 1);
+
+	return (val);
+}
+
+/* ID_AA64DFR0_EL1.PMUVer, or 0 if not available */
+static unsigned
+get_pmuver(unsigned long hwcap)
+{
+	/* the ID registers are only accessible through emulation */
+	if (!(hwcap & HWCAP_CPUID))
+		return (0);
+
+	/*
+	 * FreeBSD and Linux hide PMUVer from user space, so it reads
+	 * as 0 (not implemented) unless replaying inputs recorded with
+	 * the real register value.  0xf is an IMPLEMENTATION DEFINED
+	 * PMU, which is not PMUv3.
+	 */
+	return (get_idreg(id_aa64dfr0_el1) >> 8 & 0xf);
+}
+
+static unsigned long
+read_midr(void)
+{
+	return (read_idreg(midr_el1));
+}
+
+/*
+ * MIDR_EL1 of each CPU, or NOCPU if not available.  Unless all is set,
+ * only that of the CPU we run on (the first one recorded if replaying)
+ * is read, sparing a thread per CPU.
+ */
+static void
+get_midrs(unsigned long hwcap, unsigned long midrs[MAXCPUS], int all)
+{
+	unsigned long index;
+	int i;
+
+	for (i = 0; i < MAXCPUS; i++)
+		midrs[i] = NOCPU;
+
+	if (replaying) {
+		for (i = 0; i < MAXCPUS; i++) {
+			index = i;
+			if (!replay_lookup("midr_el1", &index, 1, midrs + i, 1))
+				midrs[i] = NOCPU;
+			else if (!all)
+				break;
+		}
+	} else if (!(hwcap & HWCAP_CPUID))
+		return;
+	else if (all)
+		foreach_cpu(read_midr, midrs);
+	else
+		midrs[0] = read_midr();
+}
+
+/* MIDR_EL1 with variant and revision masked out */
+#define MIDR_CORE(midr) ((midr) & 0xff00fff0UL)
+
+static const struct core *
+find_core(unsigned long midr)
+{
+	size_t i;
+
+	for (i = 0; cores[i].cap.name != NULL; i++)
+		if (midr >> 24 == cores[i].implementer
+		    && (midr >> 4 & 0xfff) == cores[i].part)
+			return (&cores[i]);
+
+	return (NULL);
+}
+
+static const struct core *
+is_core(const struct cap *cap)
+{
+	size_t i;
+
+	for (i = 0; cores[i].cap.name != NULL; i++)
+		if (cap == &cores[i].cap)
+			return (&cores[i]);
+
+	return (NULL);
+}
+
+static unsigned long
+read_idregs(unsigned long hwcap)
+{
+	static const unsigned pmuvers[] = { 1, 4, 5, 6, 7, 8, 9 };
+	unsigned long idregs = 0, mmfr0;
+	unsigned pmuver;
+	size_t i;
+
+	pmuver = get_pmuver(hwcap);
+	for (i = 0; i < nitems(pmuvers); i++)
+		if (pmuver != 0xf && pmuver >= pmuvers[i])
+			idregs |= IDREG_PMUV3 << i;
+
+	if (hwcap & HWCAP_CPUID) {
+		mmfr0 = get_idreg(id_aa64mmfr0_el1);
+
+		if ((mmfr0 >> 28 & 0xf) != 0xf)
+			idregs |= IDREG_TGRAN4;
+
+		if ((mmfr0 >> 20 & 0xf) != 0x0)
+			idregs |= IDREG_TGRAN16;
+
+		if ((mmfr0 >> 24 & 0xf) != 0xf)
+			idregs |= IDREG_TGRAN64;
+	}
+
+	return (idregs);
+}
+
 void
 caps_from_auxv(void)
 {
+	static unsigned long midrs[MAXCPUS];
+	const struct core *core;
 	size_t i;
-	unsigned long hwcap = 0, hwcap2 = 0;
-	int status;
-
-	status = elf_aux_info(AT_HWCAP, &hwcap, sizeof(hwcap));
-	if (status != 0 && errno != ENOENT)
-		err(EX_SOFTWARE, "elf_aux_info(AT_HWCAP)");
+	unsigned long hwcap, hwcap2, idregs;
 
-	status = elf_aux_info(AT_HWCAP2, &hwcap2, sizeof(hwcap2));
-	if (status != 0 && errno != ENOENT)
-		err(EX_SOFTWARE, "elf_aux_info(AT_HWCAP2)");
+	hwcap = get_auxv(AT_HWCAP, "hwcap");
+	hwcap2 = get_auxv(AT_HWCAP2, "hwcap2");
+	idregs = read_idregs(hwcap);
 
 	for (i = 0; caps[i].cap.name != NULL; i++)
 		if ((hwcap & caps[i].hwcap) == caps[i].hwcap
 		    && (hwcap2 & caps[i].hwcap2) == caps[i].hwcap2)
 			register_cap(&caps[i].cap);
+
+	for (i = 0; idcaps[i].cap.name != NULL; i++)
+		if ((idregs & idcaps[i].idregs) == idcaps[i].idregs)
+			register_cap(&idcaps[i].cap);
+
+	get_midrs(hwcap, midrs, all_cores);
+	for (i = 0; i < MAXCPUS; i++) {
+		if (midrs[i] == NOCPU)
+			continue;
+
+		core = find_core(midrs[i]);
+		if (core != NULL && have_cap(core->cap.name) == NULL)
+			register_cap(&core->cap);
+	}
 }
 
 void
@@ -192,6 +475,13 @@ caps_all(void)
 
 	for (i = 0; caps[i].cap.name != NULL; i++)
 		register_cap(&caps[i].cap);
+
+	for (i = 0; idcaps[i].cap.name != NULL; i++)
+		register_cap(&idcaps[i].cap);
+
+	for (i = 0; cores[i].cap.name != NULL; i++)
+		if (have_cap(cores[i].cap.name) == NULL)
+			register_cap(&cores[i].cap);
 }
 
 static int
@@ -212,7 +502,46 @@ get_archlevel(void) {
 	return (lvl);
 }
 
-void
+/*
+ * Print -mtune for the cores found, combining big and little cores.
+ * Return 0 if there were none.
+ */
+static int
+print_mtune(int first)
+{
+	const struct core *core, *big = NULL, *little = NULL;
+	size_t i;
+
+	for (i = 0; i < ncaps; i++) {
+		core = is_core(supported_caps[i]);
+		if (core == NULL)
+			continue;
+
+		if (big == NULL || core->tier > big->tier)
+			big = core;
+
+		if (little == NULL || core->tier < little->tier)
+			little = core;
+	}
+
+	if (big == NULL)
+		return (0);
+
+	printf("%s-mtune=%s", first ? "" : " ", big->cap.cflag);
+
+	/* clang rejects combined tunings */
+	if (target_cc != CC_GCC)
+		return (1);
+
+	for (i = 0; i < nitems(tune_pairs); i++)
+		if (strcmp(big->cap.cflag, tune_pairs[i][0]) == 0
+		    && strcmp(little->cap.cflag, tune_pairs[i][1]) == 0)
+			printf(".%s", little->cap.cflag);
+
+	return (1);
+}
+
+int
 print_cflags(void) {
 	const struct hwcap *lvl, *cap;
 	size_t i, j;
@@ -225,6 +554,10 @@ print_cflags(void) {
 	}
 
 	for (i = 0; i < ncaps; i++) {
+		/* cores are not entries of caps[], see print_mtune() */
+		if (is_core(supported_caps[i]) != NULL)
+			continue;
+
 		cap = (const struct hwcap *)supported_caps[i];
 
 		if (cap->cap.cflag[0] == '\0')
@@ -255,5 +588,232 @@ print_cflags(void) {
 		;
 	}
 
+	if (!print_mtune(!have_lvl && first) && !have_lvl && first)
+		return (0);
+
 	putchar('\n');
+
+	return (1);
+}
+
+void
+print_coretypes(void)
+{
+	static unsigned long midrs[MAXCPUS];
+	const struct core *core;
+	char label[20];
+	size_t i, j;
+
+	get_midrs(get_auxv(AT_HWCAP, "hwcap"), midrs, 1);
+
+	for (i = 0; i < MAXCPUS; i++)
+		if (midrs[i] != NOCPU)
+			midrs[i] = MIDR_CORE(midrs[i]);
+
+	for (i = 0; i < MAXCPUS; i++) {
+		if (midrs[i] == NOCPU)
+			continue;
+
+		core = find_core(midrs[i]);
+		if (core != NULL)
+			print_cpulist(core->cap.name, midrs, midrs[i]);
+		else {
+			snprintf(label, sizeof(label), "0x%02lx:0x%03lx",
+			    midrs[i] >> 24, midrs[i] >> 4 & 0xfff);
+			print_cpulist(label, midrs, midrs[i]);
+		}
+
+		/* don't print this core type again */
+		for (j = MAXCPUS; j-- > i; )
+			if (midrs[j] == midrs[i])
+				midrs[j] = NOCPU;
+	}
+}
+
+void
+print_pmu(void)
+{
+	unsigned pmuver;
+
+	pmuver = get_pmuver(get_auxv(AT_HWCAP, "hwcap"));
+	switch (pmuver) {
+	case 0:			/* hidden by the OS, see get_pmuver() */
+		printf("%-15s unknown\n", "version");
+		return;
+	case 0xf: printf("%-15s none\n", "version"); return;
+	case 1: printf("%-15s 3\n", "version"); break;
+	case 4: printf("%-15s 3.1\n", "version"); break;
+	case 5: printf("%-15s 3.4\n", "version"); break;
+	case 6: printf("%-15s 3.5\n", "version"); break;
+	default: printf("%-15s 3.%u\n", "version", pmuver); break;
+	}
+
+	/*
+	 * The number of event counters is only found in PMCR_EL0.N,
+	 * which is not accessible from user space.  The cycle counter
+	 * is always present and 64 bits wide.
+	 */
+	printf("%-15s %u\n", "counter_width", pmuver >= 6 ? 64 : 32);
+	printf("%-15s %u\n", "fixed_counters", 1);
+	printf("%-15s %u\n", "fixed_width", 64);
+}
+
+void
+dump_inputs(void)
+{
+	static unsigned long midrs[MAXCPUS];
+	unsigned long hwcap;
+	int i;
+
+	hwcap = get_auxv(AT_HWCAP, "hwcap");
+	printf("hwcap 0x%016lx\n", hwcap);
+	printf("hwcap2 0x%016lx\n", get_auxv(AT_HWCAP2, "hwcap2"));
+	printf("pagesz 0x%lx\n", get_auxv(AT_PAGESZ, "pagesz"));
+
+	if (hwcap & HWCAP_CPUID) {
+		printf("id_aa64dfr0_el1 0x%016lx\n", get_idreg(id_aa64dfr0_el1));
+		printf("id_aa64mmfr0_el1 0x%016lx\n", get_idreg(id_aa64mmfr0_el1));
+	}
+
+	get_midrs(hwcap, midrs, 1);
+	for (i = 0; i < MAXCPUS; i++)
+		if (midrs[i] != NOCPU)
+			printf("midr_el1 %d 0x%016lx\n", i, midrs[i]);
+}
+
+/*
+ * Translation granules and the block sizes they provide, including
+ * those reached through the contiguous bit.
+ */
+static const struct granule {
+	unsigned long idreg;
+	size_t size;
+	size_t blocks[4];
+} granules[] = {
+	IDREG_TGRAN4,  4 * 1024,
+	    64 * 1024, 2 * 1024 * 1024, 32 * 1024 * 1024, 1024 * 1024 * 1024,
+	IDREG_TGRAN16, 16 * 1024,
+	    2 * 1024 * 1024, 32 * 1024 * 1024, 1024 * 1024 * 1024, 0,
+	IDREG_TGRAN64, 64 * 1024,
+	    2 * 1024 * 1024, 512 * 1024 * 1024, 16UL * 1024 * 1024 * 1024, 0,
+};
+
+static size_t
+add_pagesize(size_t sizes[], size_t i, size_t n, size_t size)
+{
+	size_t j;
+
+	for (j = 0; j < i; j++)
+		if (sizes[j] == size)
+			return (i);
+
+	if (i >= n)
+		return (i);
+
+	/* keep sizes sorted */
+	for (j = i; j > 0 && sizes[j - 1] > size; j--)
+		sizes[j] = sizes[j - 1];
+
+	sizes[j] = size;
+
+	return (i + 1);
+}
+
+/* the granule the kernel uses, from getpagesize() for old dumps */
+static size_t
+get_pagesz(void)
+{
+	unsigned long pagesz;
+
+	pagesz = get_auxv(AT_PAGESZ, "pagesz");
+
+	return (pagesz != 0 ? pagesz : (size_t)getpagesize());
+}
+
+/*
+ * Report the granule the kernel uses and the other granules the
+ * hardware supports.  The kernel may sanitise the TGran fields of
+ * ID_AA64MMFR0_EL1, so the latter are best effort while the granule
+ * in use is known from AT_PAGESZ.
+ */
+size_t
+get_granules(size_t sizes[], size_t n)
+{
+	unsigned long hwcap, idregs = 0;
+	size_t i = 0, j, pagesz;
+
+	hwcap = get_auxv(AT_HWCAP, "hwcap");
+	if (hwcap & HWCAP_CPUID)
+		idregs = read_idregs(hwcap);
+
+	pagesz = get_pagesz();
+	for (j = 0; j < nitems(granules); j++)
+		if (granules[j].size == pagesz || idregs & granules[j].idreg)
+			i = add_pagesize(sizes, i, n, granules[j].size);
+
+	return (i);
+}
+
+/* report the block sizes of the granule in use */
+size_t
+get_pagesizes(size_t sizes[], size_t n)
+{
+	size_t i = 0, j, k, pagesz;
+
+	pagesz = get_pagesz();
+	for (j = 0; j < nitems(granules); j++) {
+		if (granules[j].size != pagesz)
+			continue;
+
+		for (k = 0; k < nitems(granules[j].blocks); k++)
+			if (granules[j].blocks[k] != 0)
+				i = add_pagesize(sizes, i, n, granules[j].blocks[k]);
+	}
+
+	return (i);
+}
+#else /* LIBHWCAP */
+/*
+ * Function dispatch, see hwcap_resolve(3) and resolve.h.  Only the
+ * capabilities from AT_HWCAP and AT_HWCAP2 are known.  Ifunc resolvers
+ * are passed these and call hwcap_resolve_auxv(), so hwcap_resolve()
+ * is free to get them from elf_aux_info(3).
+ */
+static int
+resolve_have(const char *name, size_t len, const void *arg)
+{
+	const unsigned long *hwcaps = arg;
+	size_t i;
+
+	for (i = 0; caps[i].cap.name != NULL; i++)
+		if (resolve_name_is(caps[i].cap.name, name, len))
+			return ((hwcaps[0] & caps[i].hwcap) == caps[i].hwcap
+			    && (hwcaps[1] & caps[i].hwcap2) == caps[i].hwcap2);
+
+	return (0);
+}
+
+hwcap_fn
+hwcap_resolve_auxv(const struct hwcap_candidate *cand, unsigned long hwcap,
+    unsigned long hwcap2)
+{
+	unsigned long hwcaps[2];
+
+	hwcaps[0] = hwcap;
+	hwcaps[1] = hwcap2;
+	cand = resolve_match(cand, resolve_have, hwcaps);
+
+	return (cand != NULL ? cand->fn : NULL);
+}
+
+hwcap_fn
+hwcap_resolve(const struct hwcap_candidate *cand)
+{
+	unsigned long hwcap = 0, hwcap2 = 0;
+
+	elf_aux_info(AT_HWCAP, &hwcap, sizeof(hwcap));
+	elf_aux_info(AT_HWCAP2, &hwcap2, sizeof(hwcap2));
+
+	return (hwcap_resolve_auxv(cand, hwcap, hwcap2));
 }
+#endif /* LIBHWCAP */
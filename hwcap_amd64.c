@@ -1,7 +1,29 @@
+#include <sys/param.h>
+
+#include <assert.h>
+#include <stdio.h>
 #include <string.h>
 #include <x86/specialreg.h>
 
 #include "hwcap.h"
+#include "hwcap_resolve.h"
+#include "resolve.h"
+
+/*
+ * Synthesized from leaf 0x0000000a: one bit per architectural
+ * performance monitoring event available (ebx inverted and
+ * masked to the length given in eax), plus a bit indicating
+ * architectural performance monitoring is supported at all.
+ */
+#define PERFMON_EVT_CORE_CYCLES		0x00000001
+#define PERFMON_EVT_INSTRUCTIONS	0x00000002
+#define PERFMON_EVT_REF_CYCLES		0x00000004
+#define PERFMON_EVT_LLC_REFERENCES	0x00000008
+#define PERFMON_EVT_LLC_MISSES		0x00000010
+#define PERFMON_EVT_BRANCHES		0x00000020
+#define PERFMON_EVT_BRANCH_MISSES	0x00000040
+#define PERFMON_EVT_TOPDOWN_SLOTS	0x00000080
+#define PERFMON_ARCH			0x80000000
 
 /* from Linux: arch/x86/include/asm/cpufeatures.h */
 static const struct hwcap {
@@ -160,24 +182,291 @@ static const struct hwcap {
 	"core_capabilities", "", "IA32_CORE_CAPABILITIES MSR available", 4, CPUID_STDEXT3_CORE_CAP,
 	"spec_ctrl_ssbd", "", "speculative store bypass disable", 4, CPUID_STDEXT3_SSBD,
 
+	/* leaf 0xa (synthesized) */
+	"arch_perfmon", "", "architectural performance monitoring", 5, PERFMON_ARCH,
+	"pmu_core_cycles", "", "PMU event: unhalted core cycles", 5, PERFMON_EVT_CORE_CYCLES,
+	"pmu_instructions", "", "PMU event: instructions retired", 5, PERFMON_EVT_INSTRUCTIONS,
+	"pmu_ref_cycles", "", "PMU event: unhalted reference cycles", 5, PERFMON_EVT_REF_CYCLES,
+	"pmu_llc_references", "", "PMU event: last level cache references", 5, PERFMON_EVT_LLC_REFERENCES,
+	"pmu_llc_misses", "", "PMU event: last level cache misses", 5, PERFMON_EVT_LLC_MISSES,
+	"pmu_branches", "", "PMU event: branch instructions retired", 5, PERFMON_EVT_BRANCHES,
+	"pmu_branch_misses", "", "PMU event: branch mispredicts retired", 5, PERFMON_EVT_BRANCH_MISSES,
+	"pmu_topdown_slots", "", "PMU event: topdown slots", 5, PERFMON_EVT_TOPDOWN_SLOTS,
+
+	/* leaf 0x80000001, edx */
+	"syscall", "", "syscall and sysret instructions", 6, AMDID_SYSCALL,
+	"nx", "", "no-execute page protection", 6, AMDID_NX,
+	"mmxext", "", "AMD multimedia extensions", 6, AMDID_EXT_MMX,
+	"fxsr_opt", "", "fxsave and fxrstor optimizations", 6, AMDID_FFXSR,
+	"pdpe1gb", "", "1 GB pages", 6, AMDID_PAGE1GB,
+	"rdtscp", "", "read time stamp counter and processor ID", 6, AMDID_RDTSCP,
+	"lm", "", "long mode (64-bit)", 6, AMDID_LM,
+	"3dnowext", "", "AMD 3DNow! extensions", 6, AMDID_EXT_3DNOW,
+	"3dnow", "", "AMD 3DNow!", 6, AMDID_3DNOW,
+
 	NULL, NULL, NULL, 0, 0,
 };
 
+/* capabilities only usable if the OS enables their state in XCR0 */
+static const struct xstate {
+	unsigned int xcr0;
+	unsigned int reg;
+	unsigned int bits;
+} xstates[] = {
+	XFEATURE_AVX, 1, CPUID2_AVX | CPUID2_FMA | CPUID2_F16C,
+	XFEATURE_AVX, 2, CPUID_STDEXT_AVX2,
+	XFEATURE_AVX, 3, CPUID_STDEXT2_VAES | CPUID_STDEXT2_VPCLMULQDQ,
+	XFEATURE_AVX | XFEATURE_AVX512, 2, CPUID_STDEXT_AVX512F | CPUID_STDEXT_AVX512DQ
+	    | CPUID_STDEXT_AVX512IFMA | CPUID_STDEXT_AVX512PF | CPUID_STDEXT_AVX512ER
+	    | CPUID_STDEXT_AVX512CD | CPUID_STDEXT_AVX512BW | CPUID_STDEXT_AVX512VL,
+	XFEATURE_AVX | XFEATURE_AVX512, 3, CPUID_STDEXT2_AVX512VBMI | CPUID_STDEXT2_AVX512VBMI2
+	    | CPUID_STDEXT2_AVX512VNNI | CPUID_STDEXT2_AVX512BITALG | CPUID_STDEXT2_AVX512VPOPCNTDQ,
+	XFEATURE_AVX | XFEATURE_AVX512, 4, CPUID_STDEXT3_AVX5124VNNIW | CPUID_STDEXT3_AVX5124FMAPS
+	    | CPUID_STDEXT3_AVX512VP2INTERSECT | 0x00800000 /* avx512_fp16 */,
+	0x00060000 /* XTILECFG, XTILEDATA */, 4, 0x00400000 | 0x01000000 | 0x02000000 /* amx */,
+	0, 0, 0,
+};
+
+/* clear the bits of capabilities whose state is not enabled in xcr0 */
+static void
+mask_xstates(unsigned bits[7], unsigned xcr0)
+{
+	const struct xstate *x;
+
+	for (x = xstates; x->bits != 0; x++)
+		if ((xcr0 & x->xcr0) != x->xcr0)
+			bits[x->reg] &= ~x->bits;
+}
+
+
+#ifndef LIBHWCAP
+/* microarchitectures by vendor, family, model, and stepping */
+#define INTEL	"GenuineIntel"
+#define AMD	"AuthenticAMD"
+#define HYGON	"HygonGenuine"
+#define ANY	0x0, 0xf	/* any stepping */
+
+static const struct uarch {
+	struct cap cap;
+	const char *vendor;
+	unsigned int family, model_lo, model_hi, stepping_lo, stepping_hi;
+} uarchs[] = {
+	/* Intel big cores */
+	"core2", "core2", "Intel Core 2", INTEL, 0x06, 0x0f, 0x0f, ANY,
+	"core2", "core2", "Intel Core 2", INTEL, 0x06, 0x16, 0x17, ANY,
+	"core2", "core2", "Intel Core 2", INTEL, 0x06, 0x1d, 0x1d, ANY,
+	"nehalem", "nehalem", "Intel Nehalem", INTEL, 0x06, 0x1a, 0x1a, ANY,
+	"nehalem", "nehalem", "Intel Nehalem", INTEL, 0x06, 0x1e, 0x1f, ANY,
+	"nehalem", "nehalem", "Intel Nehalem", INTEL, 0x06, 0x2e, 0x2e, ANY,
+	"westmere", "westmere", "Intel Westmere", INTEL, 0x06, 0x25, 0x25, ANY,
+	"westmere", "westmere", "Intel Westmere", INTEL, 0x06, 0x2c, 0x2c, ANY,
+	"westmere", "westmere", "Intel Westmere", INTEL, 0x06, 0x2f, 0x2f, ANY,
+	"sandybridge", "sandybridge", "Intel Sandy Bridge", INTEL, 0x06, 0x2a, 0x2a, ANY,
+	"sandybridge", "sandybridge", "Intel Sandy Bridge", INTEL, 0x06, 0x2d, 0x2d, ANY,
+	"ivybridge", "ivybridge", "Intel Ivy Bridge", INTEL, 0x06, 0x3a, 0x3a, ANY,
+	"ivybridge", "ivybridge", "Intel Ivy Bridge", INTEL, 0x06, 0x3e, 0x3e, ANY,
+	"haswell", "haswell", "Intel Haswell", INTEL, 0x06, 0x3c, 0x3c, ANY,
+	"haswell", "haswell", "Intel Haswell", INTEL, 0x06, 0x3f, 0x3f, ANY,
+	"haswell", "haswell", "Intel Haswell", INTEL, 0x06, 0x45, 0x46, ANY,
+	"broadwell", "broadwell", "Intel Broadwell", INTEL, 0x06, 0x3d, 0x3d, ANY,
+	"broadwell", "broadwell", "Intel Broadwell", INTEL, 0x06, 0x47, 0x47, ANY,
+	"broadwell", "broadwell", "Intel Broadwell", INTEL, 0x06, 0x4f, 0x4f, ANY,
+	"broadwell", "broadwell", "Intel Broadwell", INTEL, 0x06, 0x56, 0x56, ANY,
+	"skylake", "skylake", "Intel Skylake (client)", INTEL, 0x06, 0x4e, 0x4e, ANY,
+	"skylake", "skylake", "Intel Skylake (client)", INTEL, 0x06, 0x5e, 0x5e, ANY,
+	"skylake", "skylake", "Intel Kaby Lake / Coffee Lake", INTEL, 0x06, 0x8e, 0x8e, ANY,
+	"skylake", "skylake", "Intel Kaby Lake / Coffee Lake", INTEL, 0x06, 0x9e, 0x9e, ANY,
+	"skylake", "skylake", "Intel Comet Lake", INTEL, 0x06, 0xa5, 0xa6, ANY,
+	"skylake-avx512", "skylake-avx512", "Intel Skylake (server)", INTEL, 0x06, 0x55, 0x55, 0x0, 0x4,
+	"cascadelake", "cascadelake", "Intel Cascade Lake", INTEL, 0x06, 0x55, 0x55, 0x5, 0x7,
+	"cooperlake", "cooperlake", "Intel Cooper Lake", INTEL, 0x06, 0x55, 0x55, 0xa, 0xb,
+	"cannonlake", "cannonlake", "Intel Cannon Lake", INTEL, 0x06, 0x66, 0x66, ANY,
+	"icelake-client", "icelake-client", "Intel Ice Lake (client)", INTEL, 0x06, 0x7d, 0x7e, ANY,
+	"icelake-server", "icelake-server", "Intel Ice Lake (server)", INTEL, 0x06, 0x6a, 0x6a, ANY,
+	"icelake-server", "icelake-server", "Intel Ice Lake (server)", INTEL, 0x06, 0x6c, 0x6c, ANY,
+	"tigerlake", "tigerlake", "Intel Tiger Lake", INTEL, 0x06, 0x8c, 0x8d, ANY,
+	"rocketlake", "rocketlake", "Intel Rocket Lake", INTEL, 0x06, 0xa7, 0xa7, ANY,
+	"alderlake", "alderlake", "Intel Alder Lake", INTEL, 0x06, 0x97, 0x97, ANY,
+	"alderlake", "alderlake", "Intel Alder Lake", INTEL, 0x06, 0x9a, 0x9a, ANY,
+	"raptorlake", "raptorlake", "Intel Raptor Lake", INTEL, 0x06, 0xb7, 0xb7, ANY,
+	"raptorlake", "raptorlake", "Intel Raptor Lake", INTEL, 0x06, 0xba, 0xba, ANY,
+	"raptorlake", "raptorlake", "Intel Raptor Lake", INTEL, 0x06, 0xbf, 0xbf, ANY,
+	"meteorlake", "meteorlake", "Intel Meteor Lake", INTEL, 0x06, 0xaa, 0xaa, ANY,
+	"meteorlake", "meteorlake", "Intel Meteor Lake", INTEL, 0x06, 0xac, 0xac, ANY,
+	"arrowlake", "arrowlake", "Intel Arrow Lake", INTEL, 0x06, 0xc5, 0xc5, ANY,
+	"arrowlake-s", "arrowlake-s", "Intel Arrow Lake S", INTEL, 0x06, 0xc6, 0xc6, ANY,
+	"lunarlake", "lunarlake", "Intel Lunar Lake", INTEL, 0x06, 0xbd, 0xbd, ANY,
+	"pantherlake", "pantherlake", "Intel Panther Lake", INTEL, 0x06, 0xcc, 0xcc, ANY,
+	"sapphirerapids", "sapphirerapids", "Intel Sapphire Rapids", INTEL, 0x06, 0x8f, 0x8f, ANY,
+	"emeraldrapids", "emeraldrapids", "Intel Emerald Rapids", INTEL, 0x06, 0xcf, 0xcf, ANY,
+	"graniterapids", "graniterapids", "Intel Granite Rapids", INTEL, 0x06, 0xad, 0xad, ANY,
+	"graniterapids-d", "graniterapids-d", "Intel Granite Rapids D", INTEL, 0x06, 0xae, 0xae, ANY,
+
+	/* Intel small cores */
+	"bonnell", "bonnell", "Intel Bonnell (Atom)", INTEL, 0x06, 0x1c, 0x1c, ANY,
+	"bonnell", "bonnell", "Intel Bonnell (Atom)", INTEL, 0x06, 0x26, 0x27, ANY,
+	"bonnell", "bonnell", "Intel Bonnell (Atom)", INTEL, 0x06, 0x35, 0x36, ANY,
+	"silvermont", "silvermont", "Intel Silvermont", INTEL, 0x06, 0x37, 0x37, ANY,
+	"silvermont", "silvermont", "Intel Silvermont", INTEL, 0x06, 0x4a, 0x4a, ANY,
+	"silvermont", "silvermont", "Intel Airmont", INTEL, 0x06, 0x4c, 0x4d, ANY,
+	"silvermont", "silvermont", "Intel Silvermont", INTEL, 0x06, 0x5a, 0x5a, ANY,
+	"silvermont", "silvermont", "Intel Silvermont", INTEL, 0x06, 0x5d, 0x5d, ANY,
+	"goldmont", "goldmont", "Intel Goldmont", INTEL, 0x06, 0x5c, 0x5c, ANY,
+	"goldmont", "goldmont", "Intel Goldmont", INTEL, 0x06, 0x5f, 0x5f, ANY,
+	"goldmont-plus", "goldmont-plus", "Intel Goldmont Plus", INTEL, 0x06, 0x7a, 0x7a, ANY,
+	"tremont", "tremont", "Intel Tremont", INTEL, 0x06, 0x86, 0x86, ANY,
+	"tremont", "tremont", "Intel Tremont", INTEL, 0x06, 0x96, 0x96, ANY,
+	"tremont", "tremont", "Intel Tremont", INTEL, 0x06, 0x9c, 0x9c, ANY,
+	"sierraforest", "sierraforest", "Intel Sierra Forest", INTEL, 0x06, 0xaf, 0xaf, ANY,
+	"grandridge", "grandridge", "Intel Grand Ridge", INTEL, 0x06, 0xb6, 0xb6, ANY,
+	"clearwaterforest", "clearwaterforest", "Intel Clearwater Forest", INTEL, 0x06, 0xdd, 0xdd, ANY,
+
+	/* Intel Xeon Phi */
+	"knl", "knl", "Intel Knights Landing", INTEL, 0x06, 0x57, 0x57, ANY,
+	"knm", "knm", "Intel Knights Mill", INTEL, 0x06, 0x85, 0x85, ANY,
+
+	/* AMD */
+	"btver1", "btver1", "AMD Bobcat", AMD, 0x14, 0x00, 0xff, ANY,
+	"bdver2", "bdver2", "AMD Piledriver", AMD, 0x15, 0x02, 0x02, ANY,
+	"bdver1", "bdver1", "AMD Bulldozer", AMD, 0x15, 0x00, 0x0f, ANY,
+	"bdver2", "bdver2", "AMD Piledriver", AMD, 0x15, 0x10, 0x1f, ANY,
+	"bdver3", "bdver3", "AMD Steamroller", AMD, 0x15, 0x30, 0x3f, ANY,
+	"bdver4", "bdver4", "AMD Excavator", AMD, 0x15, 0x60, 0x7f, ANY,
+	"btver2", "btver2", "AMD Jaguar", AMD, 0x16, 0x00, 0xff, ANY,
+	"znver1", "znver1", "AMD Zen", AMD, 0x17, 0x00, 0x2f, ANY,
+	"znver2", "znver2", "AMD Zen 2", AMD, 0x17, 0x30, 0xff, ANY,
+	"znver3", "znver3", "AMD Zen 3", AMD, 0x19, 0x00, 0x0f, ANY,
+	"znver4", "znver4", "AMD Zen 4", AMD, 0x19, 0x10, 0x1f, ANY,
+	"znver3", "znver3", "AMD Zen 3", AMD, 0x19, 0x20, 0x5f, ANY,
+	"znver4", "znver4", "AMD Zen 4", AMD, 0x19, 0x60, 0xaf, ANY,
+	"znver5", "znver5", "AMD Zen 5", AMD, 0x1a, 0x00, 0xff, ANY,
+
+	/* Hygon */
+	"znver1", "znver1", "Hygon Dhyana", HYGON, 0x18, 0x00, 0xff, ANY,
+
+	NULL, NULL, NULL, NULL, 0, 0, 0, 0, 0,
+};
+
+/*
+ * Capabilities the compiler may use without being asked to when given
+ * -march=<uarch>, as far as we can detect them.  Instructions only
+ * reachable through intrinsics, like aes or waitpkg, are left out.
+ * Pentium and Celeron parts lack AVX and virtual machines often hide
+ * AVX-512, so vendor, family, and model alone do not make
+ * -march=<uarch> safe to use.  The lists are separated by blanks.
+ */
+#define V1		"cmov cx8 fpu fxsr mmx sse sse2"
+#define V2		V1 " cx16 popcnt pni ssse3 sse4_1 sse4_2"
+#define V3		V2 " avx avx2 bmi1 bmi2 f16c fma movbe xsave"
+#define V4		V3 " avx512f avx512bw avx512cd avx512dq avx512vl"
+#define NEHALEM		V2
+#define SANDYBRIDGE	NEHALEM " avx"
+#define IVYBRIDGE	SANDYBRIDGE " f16c"
+#define HASWELL		IVYBRIDGE " avx2 bmi1 bmi2 fma movbe"
+#define SKYLAKE_AVX512	HASWELL " avx512f avx512cd avx512bw avx512dq avx512vl"
+#define CANNONLAKE	SKYLAKE_AVX512 " avx512ifma avx512vbmi"
+#define ICELAKE		CANNONLAKE " avx512_vbmi2 avx512_vnni avx512_bitalg" \
+			" avx512_vpopcntdq gfni"
+#define ALDERLAKE	HASWELL " gfni"
+#define SILVERMONT	NEHALEM " movbe"
+#define TREMONT		SILVERMONT " gfni"
+#define KNL		HASWELL " avx512f avx512cd avx512er"
+#define BDVER1		NEHALEM " avx"
+#define BDVER2		BDVER1 " fma bmi1 f16c"
+
+static const struct uarch_isa {
+	const char *name, *requires;
+} uarch_isas[] = {
+	"core2", "ssse3 cx16",
+	"nehalem", NEHALEM,
+	"westmere", NEHALEM,
+	"sandybridge", SANDYBRIDGE,
+	"ivybridge", IVYBRIDGE,
+	"haswell", HASWELL,
+	"broadwell", HASWELL,
+	"skylake", HASWELL,
+	"skylake-avx512", SKYLAKE_AVX512,
+	"cascadelake", SKYLAKE_AVX512 " avx512_vnni",
+	"cooperlake", SKYLAKE_AVX512 " avx512_vnni",
+	"cannonlake", CANNONLAKE,
+	"icelake-client", ICELAKE,
+	"icelake-server", ICELAKE,
+	"tigerlake", ICELAKE,
+	"rocketlake", ICELAKE,
+	"alderlake", ALDERLAKE,
+	"raptorlake", ALDERLAKE,
+	"meteorlake", ALDERLAKE,
+	"arrowlake", ALDERLAKE,
+	"arrowlake-s", ALDERLAKE,
+	"lunarlake", ALDERLAKE,
+	"pantherlake", ALDERLAKE,
+	"sapphirerapids", ICELAKE " avx512_fp16",
+	"emeraldrapids", ICELAKE " avx512_fp16",
+	"graniterapids", ICELAKE " avx512_fp16",
+	"graniterapids-d", ICELAKE " avx512_fp16",
+	"bonnell", "ssse3 cx16 movbe",
+	"silvermont", SILVERMONT,
+	"goldmont", SILVERMONT,
+	"goldmont-plus", SILVERMONT,
+	"tremont", TREMONT,
+	"sierraforest", ALDERLAKE,
+	"grandridge", ALDERLAKE,
+	"clearwaterforest", ALDERLAKE,
+	"knl", KNL,
+	"knm", KNL " avx512_vpopcntdq",
+	"btver1", "ssse3 cx16",
+	"bdver1", BDVER1,
+	"bdver2", BDVER2,
+	"bdver3", BDVER2,
+	"bdver4", BDVER2 " avx2 bmi2 movbe",
+	"btver2", BDVER1 " bmi1 f16c movbe",
+	"znver1", HASWELL,
+	"znver2", HASWELL,
+	"znver3", HASWELL,
+	"znver4", ICELAKE,
+	"znver5", ICELAKE,
+
+	NULL, NULL,
+};
+
+/* x86-64 psABI levels, the fallback for -march, lowest first */
+static const struct uarch_isa levels[] = {
+	"x86-64", V1,
+	"x86-64-v2", V2,
+	"x86-64-v3", V3,
+	"x86-64-v4", V4,
+};
+
 /*
  *  0 -- leaf 0x00000001, edx
  *  1 -- leaf 0x00000001, ecx
  *  2 -- leaf 0x00000007:0, ebx
  *  3 -- leaf 0x00000007:0, ecx
  *  4 -- leaf 0x00000007:0, edx
+ *  5 -- leaf 0x0000000a (synthesized, see above)
+ *  6 -- leaf 0x80000001, edx
  */
-static unsigned int cpuid_bits[2];
+static unsigned int cpuid_bits[7];
+static unsigned int cpuid_max_leaf;
+
+/* leaf 0x0000000a, eax and edx */
+static unsigned int perfmon_eax, perfmon_edx;
 
 static inline void
-cpuid(unsigned leaf, unsigned *eax, unsigned *ebx, unsigned *ecx, unsigned *edx)
+cpuidx(unsigned leaf, unsigned sub, unsigned *eax, unsigned *ebx, unsigned *ecx, unsigned *edx)
 {
 	unsigned a, b, c, d;
 
-	asm ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf));
+	if (replaying) {
+		unsigned long index[2] = { leaf, sub }, val[4];
+
+		replay_lookup("cpuid", index, 2, val, 4);
+		a = val[0];
+		b = val[1];
+		c = val[2];
+		d = val[3];
+	} else
+		asm ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(sub));
 
 	if (eax != NULL)
 		*eax = a;
@@ -193,48 +482,135 @@ cpuid(unsigned leaf, unsigned *eax, unsigned *ebx, unsigned *ecx, unsigned *edx)
 }
 
 static inline void
-cpuidx(unsigned leaf, unsigned sub, unsigned *eax, unsigned *ebx, unsigned *ecx, unsigned *edx)
+cpuid(unsigned leaf, unsigned *eax, unsigned *ebx, unsigned *ecx, unsigned *edx)
 {
-	unsigned a, b, c, d;
+	cpuidx(leaf, 0, eax, ebx, ecx, edx);
+}
 
-	asm ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(sub));
+static void
+populate_perfmon_bits(void)
+{
+	unsigned ebx, len;
 
-	if (eax != NULL)
-		*eax = a;
+	cpuid(0xa, &perfmon_eax, &ebx, NULL, &perfmon_edx);
 
-	if (ebx != NULL)
-		*ebx = b;
+	/* version 0: no architectural performance monitoring */
+	if ((perfmon_eax & 0xff) == 0)
+		return;
 
-	if (ecx != NULL)
-		*ecx = c;
+	/* ebx has a bit set for each event NOT available */
+	len = perfmon_eax >> 24;
+	if (len < 32)
+		ebx |= ~0U << len;
 
-	if (edx != NULL)
-		*edx = d;
+	cpuid_bits[5] = PERFMON_ARCH | (~ebx & ~PERFMON_ARCH);
+}
+
+/*
+ * XCR0, telling which register state the OS enables, or 0 if it
+ * does not support xgetbv.  Dumps without an xgetbv record predate it
+ * and are taken to have all state enabled.
+ */
+static unsigned
+get_xcr0(void)
+{
+	unsigned long index = 0, val;
+	unsigned ecx, xcr0, xcr0_hi;
+
+	if (replaying)
+		return (replay_lookup("xgetbv", &index, 1, &val, 1) ? val : ~0U);
+
+	cpuid(1, NULL, NULL, &ecx, NULL);
+	if (!(ecx & CPUID2_OSXSAVE))
+		return (0);
+
+	asm ("xgetbv" : "=a"(xcr0), "=d"(xcr0_hi) : "c"(0));
+
+	return (xcr0);
 }
 
 static void
 populate_cpuid_bits(void) {
-	unsigned max_leaf;
+	unsigned max_ext_leaf;
 
 	/* TODO: on i386, check if cpuid supported before trying it */
 	memset(cpuid_bits, 0, sizeof(cpuid_bits));
+	perfmon_eax = 0;
+	perfmon_edx = 0;
 
-	cpuid(0, &max_leaf, NULL, NULL, NULL);
+	cpuid(0x80000000, &max_ext_leaf, NULL, NULL, NULL);
+	if (max_ext_leaf >= 0x80000001)
+		cpuid(0x80000001, NULL, NULL, NULL, cpuid_bits + 6);
 
-	if (max_leaf < 1)
+	cpuid(0, &cpuid_max_leaf, NULL, NULL, NULL);
+
+	if (cpuid_max_leaf < 1)
 		return;
 
 	cpuid(1, NULL, NULL, cpuid_bits + 1, cpuid_bits + 0);
 
-	if (max_leaf < 7)
+	if (cpuid_max_leaf >= 7)
+		cpuidx(7, 0, NULL, cpuid_bits + 2, cpuid_bits + 3, cpuid_bits + 4);
+
+	/* AVX and later are unusable unless the OS saves their state */
+	mask_xstates(cpuid_bits, get_xcr0());
+
+	if (cpuid_max_leaf < 0xa)
 		return;
 
-	cpuidx(7, 0, NULL, cpuid_bits + 2, cpuid_bits + 3, cpuid_bits + 4);
+	populate_perfmon_bits();
+}
+
+static const struct uarch *
+get_uarch(void)
+{
+	const struct uarch *u;
+	unsigned max_leaf, eax, family, model, stepping;
+	unsigned vendor[3];
+
+	/* the vendor string is in ebx, edx, ecx, in that order */
+	cpuid(0, &max_leaf, vendor + 0, vendor + 2, vendor + 1);
+	if (max_leaf < 1)
+		return (NULL);
+
+	cpuid(1, &eax, NULL, NULL, NULL);
+
+	stepping = eax & 0xf;
+	model = eax >> 4 & 0xf;
+	family = eax >> 8 & 0xf;
+
+	if (family == 0x6 || family == 0xf)
+		model |= (eax >> 16 & 0xf) << 4;
+
+	if (family == 0xf)
+		family += eax >> 20 & 0xff;
+
+	for (u = uarchs; u->cap.name != NULL; u++)
+		if (memcmp(vendor, u->vendor, sizeof(vendor)) == 0
+		    && family == u->family
+		    && model >= u->model_lo && model <= u->model_hi
+		    && stepping >= u->stepping_lo && stepping <= u->stepping_hi)
+			return (u);
+
+	return (NULL);
+}
+
+static int
+is_uarch(const struct cap *cap)
+{
+	size_t i;
+
+	for (i = 0; uarchs[i].cap.name != NULL; i++)
+		if (cap == &uarchs[i].cap)
+			return (1);
+
+	return (0);
 }
 
 void
 caps_from_auxv(void)
 {
+	const struct uarch *uarch;
 	size_t i;
 
 	populate_cpuid_bits();
@@ -242,22 +618,431 @@ caps_from_auxv(void)
 	for (i = 0; caps[i].cap.name != NULL; i++)
 		if ((cpuid_bits[caps[i].reg] & caps[i].bits) == caps[i].bits)
 			register_cap(&caps[i].cap);
+
+	uarch = get_uarch();
+	if (uarch != NULL)
+		register_cap(&uarch->cap);
 }
 
 void
 caps_all(void)
 {
-	size_t i;
+	size_t i, j;
 
 	for (i = 0; caps[i].cap.name != NULL; i++)
 		register_cap(&caps[i].cap);
+
+	/* some microarchitectures have multiple entries */
+	for (i = 0; uarchs[i].cap.name != NULL; i++) {
+		for (j = 0; j < i; j++)
+			if (strcmp(uarchs[i].cap.name, uarchs[j].cap.name) == 0)
+				goto skip_this_uarch;
+
+		register_cap(&uarchs[i].cap);
+
+	skip_this_uarch:
+		;
+	}
 }
 
+/* the microarchitecture is the closest thing to an architecture level */
 const struct cap *
 get_archlevel(void) {
+	const struct cap *lvl = NULL;
+	size_t i;
+
+	for (i = 0; i < ncaps; i++)
+		if (is_uarch(supported_caps[i]))
+			lvl = supported_caps[i];
+
+	return (lvl);
+}
+
+/* is the capability named name detected by cpuid? */
+static int
+cpuid_has(const char *name)
+{
+	size_t i;
+
+	for (i = 0; caps[i].cap.name != NULL; i++)
+		if (strcmp(caps[i].cap.name, name) == 0)
+			return ((cpuid_bits[caps[i].reg] & caps[i].bits) == caps[i].bits);
+
+	return (0);
+}
+
+/*
+ * Does the blank separated list of capabilities contain name?  With
+ * name NULL, are all capabilities of the list detected?
+ */
+static int
+list_has(const char *list, const char *name)
+{
+	char cap[64];
+	size_t len;
+
+	for (;;) {
+		list += strspn(list, " ");
+		len = strcspn(list, " ");
+		if (len == 0)
+			return (name == NULL);
+
+		assert(len < sizeof(cap));
+		memcpy(cap, list, len);
+		cap[len] = '\0';
+		list += len;
+
+		if (name != NULL && strcmp(cap, name) == 0)
+			return (1);
+
+		if (name == NULL && !cpuid_has(cap))
+			return (0);
+	}
+}
+
+/* were all wanted capabilities detected, and does the list cover them? */
+static int
+covers_wanted(const char *list)
+{
+	const struct cap *cap;
+	size_t i;
+
+	for (i = 0; wanted_caps[i] != NULL; i++) {
+		cap = have_cap(wanted_caps[i]);
+		if (cap == NULL)
+			return (0);
+
+		if (!is_uarch(cap) && !list_has(list, cap->name))
+			return (0);
+	}
+
+	return (1);
+}
+
+/*
+ * The -march option for the microarchitecture lvl if all capabilities
+ * it enables were detected, else for the highest x86-64 level found.
+ * If only some capabilities are wanted, the lowest level found that
+ * covers them.  NULL if there is none.
+ */
+static const char *
+get_march(const struct cap *lvl)
+{
+	const struct uarch_isa *isa;
+	size_t i;
+
+	for (isa = uarch_isas; lvl != NULL && isa->name != NULL; isa++)
+		if (strcmp(isa->name, lvl->name) == 0 && list_has(isa->requires, NULL))
+			return (lvl->cflag);
+
+	if (wanted_caps == NULL) {
+		for (i = nitems(levels); i-- > 0; )
+			if (list_has(levels[i].requires, NULL))
+				return (levels[i].name);
+	} else {
+		for (i = 0; i < nitems(levels); i++)
+			if (list_has(levels[i].requires, NULL)
+			    && covers_wanted(levels[i].requires))
+				return (levels[i].name);
+	}
+
 	return (NULL);
 }
 
-void
+int
 print_cflags(void) {
+	const struct cap *lvl;
+	const char *march;
+
+	lvl = get_archlevel();
+	march = get_march(lvl);
+	if (march == NULL)
+		return (0);
+
+	if (lvl != NULL)
+		printf("-march=%s -mtune=%s\n", march, lvl->cflag);
+	else
+		printf("-march=%s\n", march);
+
+	return (1);
+}
+
+/* leaf 0x1a, eax bits 31--24 */
+static const struct coretype {
+	unsigned long type;
+	const char *name;
+} coretypes[] = {
+	0x00, "uniform",	/* not a hybrid CPU */
+	0x20, "atom",
+	0x40, "core",
+	0, NULL,
+};
+
+static unsigned long
+read_leaf_1a(void)
+{
+	unsigned eax;
+
+	cpuidx(0x1a, 0, &eax, NULL, NULL, NULL);
+
+	return (eax);
+}
+
+static unsigned long
+get_zero(void)
+{
+	return (0);
+}
+
+/*
+ * Leaf 0x1a eax of each CPU, 0 on CPUs that are not hybrid, or NOCPU
+ * for CPUs not available.  When replaying, these come from the
+ * cpuid_1a records written by dump_inputs().
+ */
+static void
+get_leaves_1a(unsigned long eaxs[MAXCPUS])
+{
+	unsigned long index;
+	int i;
+
+	if (replaying) {
+		for (i = 0; i < MAXCPUS; i++) {
+			index = i;
+			if (!replay_lookup("cpuid_1a", &index, 1, eaxs + i, 1))
+				eaxs[i] = NOCPU;
+		}
+
+		return;
+	}
+
+	populate_cpuid_bits();
+
+	/* leaf 0x1a is only valid on hybrid CPUs */
+	if (cpuid_max_leaf >= 0x1a && cpuid_bits[4] & 0x00008000)
+		foreach_cpu(read_leaf_1a, eaxs);
+	else
+		foreach_cpu(get_zero, eaxs);
+}
+
+void
+print_coretypes(void)
+{
+	static unsigned long types[MAXCPUS];
+	char label[20];
+	size_t i, j;
+
+	get_leaves_1a(types);
+	for (i = 0; i < MAXCPUS; i++)
+		if (types[i] != NOCPU)
+			types[i] = types[i] >> 24 & 0xff;
+
+	for (i = 0; coretypes[i].name != NULL; i++)
+		print_cpulist(coretypes[i].name, types, coretypes[i].type);
+
+	/* core types we do not know about */
+	for (i = 0; i < MAXCPUS; i++) {
+		if (types[i] == NOCPU)
+			continue;
+
+		for (j = 0; coretypes[j].name != NULL; j++)
+			if (types[i] == coretypes[j].type)
+				goto known_type;
+
+		snprintf(label, sizeof(label), "0x%02lx", types[i]);
+		print_cpulist(label, types, types[i]);
+
+		/* don't print this type again */
+		for (j = MAXCPUS; j-- > i; )
+			if (types[j] == types[i])
+				types[j] = NOCPU;
+
+	known_type:
+		;
+	}
+}
+
+void
+print_pmu(void)
+{
+	unsigned version;
+	size_t i;
+
+	populate_cpuid_bits();
+
+	version = perfmon_eax & 0xff;
+	if (version == 0) {
+		printf("%-15s none\n", "version");
+		return;
+	}
+
+	printf("%-15s %u\n", "version", version);
+
+	printf("%-15s %u\n", "counters", perfmon_eax >> 8 & 0xff);
+	printf("%-15s %u\n", "counter_width", perfmon_eax >> 16 & 0xff);
+
+	/* fixed-function counters are enumerated from version 2 on */
+	if (version >= 2) {
+		printf("%-15s %u\n", "fixed_counters", perfmon_edx & 0x1f);
+		printf("%-15s %u\n", "fixed_width", perfmon_edx >> 5 & 0xff);
+	}
+
+	printf("%-15s", "events");
+	for (i = 0; caps[i].cap.name != NULL; i++) {
+		if (caps[i].reg != 5 || caps[i].bits == PERFMON_ARCH)
+			continue;
+
+		if ((cpuid_bits[5] & caps[i].bits) != caps[i].bits)
+			continue;
+
+		printf(" %s", caps[i].cap.name);
+	}
+
+	putchar('\n');
+}
+
+/* cpuid leaves and subleaves recorded by dump_inputs() */
+static const struct {
+	unsigned leaf, sub;
+} recorded_leaves[] = {
+	0x00000000, 0,
+	0x00000001, 0,
+	0x00000007, 0,
+	0x0000000a, 0,
+	0x0000001a, 0,
+	0x80000000, 0,
+	0x80000001, 0,
+};
+
+void
+dump_inputs(void)
+{
+	static unsigned long eaxs[MAXCPUS];
+	size_t i;
+	unsigned max_leaf, max_ext_leaf, a, b, c, d;
+
+	cpuid(0, &max_leaf, NULL, NULL, NULL);
+	cpuid(0x80000000, &max_ext_leaf, NULL, NULL, NULL);
+
+	for (i = 0; i < nitems(recorded_leaves); i++) {
+		if (recorded_leaves[i].leaf >= 0x80000000) {
+			if (recorded_leaves[i].leaf > max_ext_leaf)
+				continue;
+		} else if (recorded_leaves[i].leaf > max_leaf)
+			continue;
+
+		cpuidx(recorded_leaves[i].leaf, recorded_leaves[i].sub, &a, &b, &c, &d);
+		printf("cpuid 0x%08x %u 0x%08x 0x%08x 0x%08x 0x%08x\n",
+		    recorded_leaves[i].leaf, recorded_leaves[i].sub, a, b, c, d);
+	}
+
+	if (max_leaf >= 1)
+		printf("xgetbv 0 0x%08x\n", get_xcr0());
+
+	/* leaf 0x1a differs between the CPUs of a hybrid processor */
+	get_leaves_1a(eaxs);
+	for (i = 0; i < MAXCPUS; i++)
+		if (eaxs[i] != NOCPU)
+			printf("cpuid_1a %zu 0x%08lx\n", i, eaxs[i]);
+}
+
+size_t
+get_pagesizes(size_t sizes[], size_t n)
+{
+	size_t i = 0;
+
+	populate_cpuid_bits();
+
+	assert(n >= 3);
+	sizes[i++] = 4096;
+
+	/* 2 MB pages are always available in long mode */
+	if (cpuid_bits[0] & CPUID_PSE || cpuid_bits[6] & AMDID_LM)
+		sizes[i++] = 2 * 1024 * 1024;
+
+	if (cpuid_bits[6] & AMDID_PAGE1GB)
+		sizes[i++] = 1024 * 1024 * 1024;
+
+	return (i);
+}
+
+/* there is only one translation granule, 4K */
+size_t
+get_granules(size_t sizes[], size_t n)
+{
+
+	return (0);
+}
+#else /* LIBHWCAP */
+/*
+ * Function dispatch, see hwcap_resolve(3) and resolve.h.  There are
+ * no arguments to ifunc resolvers here, so the capabilities always
+ * come from cpuid and xgetbv, which need no libc.  Replay is not
+ * supported.
+ */
+
+static void
+raw_cpuid(unsigned leaf, unsigned regs[4])
+{
+	asm ("cpuid" : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3]) : "0"(leaf), "2"(0));
+}
+
+/* like populate_cpuid_bits(), but without replay or leaf 0xa */
+static void
+raw_cpuid_bits(unsigned bits[7])
+{
+	unsigned regs[4], max_leaf, xcr0 = 0, xcr0_hi;
+
+	bits[0] = bits[1] = bits[2] = bits[3] = bits[4] = bits[5] = bits[6] = 0;
+
+	raw_cpuid(0x80000000, regs);
+	if (regs[0] >= 0x80000001) {
+		raw_cpuid(0x80000001, regs);
+		bits[6] = regs[3];
+	}
+
+	raw_cpuid(0, regs);
+	max_leaf = regs[0];
+
+	if (max_leaf >= 1) {
+		raw_cpuid(1, regs);
+		bits[0] = regs[3];
+		bits[1] = regs[2];
+	}
+
+	if (max_leaf >= 7) {
+		raw_cpuid(7, regs);
+		bits[2] = regs[1];
+		bits[3] = regs[2];
+		bits[4] = regs[3];
+	}
+
+	if (bits[1] & CPUID2_OSXSAVE)
+		asm ("xgetbv" : "=a"(xcr0), "=d"(xcr0_hi) : "c"(0));
+
+	mask_xstates(bits, xcr0);
+}
+
+static int
+resolve_have(const char *name, size_t len, const void *arg)
+{
+	const unsigned *bits = arg;
+	size_t i;
+
+	for (i = 0; caps[i].cap.name != NULL; i++)
+		if (resolve_name_is(caps[i].cap.name, name, len))
+			return ((bits[caps[i].reg] & caps[i].bits) == caps[i].bits);
+
+	return (0);
+}
+
+hwcap_fn
+hwcap_resolve(const struct hwcap_candidate *cand)
+{
+	unsigned bits[7];
+
+	raw_cpuid_bits(bits);
+	cand = resolve_match(cand, resolve_have, bits);
+
+	return (cand != NULL ? cand->fn : NULL);
 }
+#endif /* LIBHWCAP */
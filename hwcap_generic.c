@@ -1,6 +1,10 @@
 #include <stddef.h>
 
 #include "hwcap.h"
+#include "hwcap_resolve.h"
+#include "resolve.h"
+
+#ifndef LIBHWCAP
 
 void
 caps_from_auxv(void)
@@ -12,14 +16,61 @@ caps_all(void)
 {
 }
 
-void
+int
 print_cflags(void)
+{
+	return (0);
+}
+
+void
+print_coretypes(void)
 {
 }
 
+void
+print_pmu(void)
+{
+}
+
+void
+dump_inputs(void)
+{
+}
+
+size_t
+get_pagesizes(size_t sizes[], size_t n)
+{
+
+	return (0);
+}
+
+size_t
+get_granules(size_t sizes[], size_t n)
+{
+
+	return (0);
+}
+
 const struct cap *
 get_archlevel(void)
 {
 
 	return (NULL);
 }
+#else /* LIBHWCAP */
+/* no capabilities are known: only candidates requiring none match */
+static int
+resolve_have(const char *name, size_t len, const void *arg)
+{
+
+	return (0);
+}
+
+hwcap_fn
+hwcap_resolve(const struct hwcap_candidate *cand)
+{
+	cand = resolve_match(cand, resolve_have, NULL);
+
+	return (cand != NULL ? cand->fn : NULL);
+}
+#endif /* LIBHWCAP */
@@ -0,0 +1,24 @@
+/*
+ * Runtime function dispatch on hardware capabilities,
+ * see hwcap_resolve(3).
+ */
+#ifndef HWCAP_RESOLVE_H
+#define HWCAP_RESOLVE_H
+
+#include <sys/cdefs.h>
+
+typedef void	(*hwcap_fn)(void);
+
+struct hwcap_candidate {
+	const char	*requires;	/* capability names, NULL for none */
+	hwcap_fn	 fn;		/* NULL terminates the table */
+};
+
+__BEGIN_DECLS
+hwcap_fn	hwcap_resolve(const struct hwcap_candidate *);
+#if defined(__aarch64__) || defined(__riscv)
+hwcap_fn	hwcap_resolve_auxv(const struct hwcap_candidate *, unsigned long, unsigned long);
+#endif
+__END_DECLS
+
+#endif /* HWCAP_RESOLVE_H */
@@ -1,10 +1,12 @@
+#include <assert.h>
 #include <err.h>
-#include <errno.h>
 #include <stdio.h>
 #include <sys/auxv.h>
 #include <sysexits.h>
 
 #include "hwcap.h"
+#include "hwcap_resolve.h"
+#include "resolve.h"
 
 static const struct hwcap {
 	struct cap cap;
@@ -28,16 +30,15 @@ static const struct hwcap {
 	NULL, NULL, NULL, 0,
 };
 
+#ifndef LIBHWCAP
+
 void
 caps_from_auxv(void)
 {
 	size_t i;
-	unsigned long hwcap = 0;
-	int status;
+	unsigned long hwcap;
 
-	status = elf_aux_info(AT_HWCAP, &hwcap, sizeof(hwcap));
-	if (status != 0 && errno != ENOENT)
-		err(EX_SOFTWARE, "elf_aux_info(AT_HWCAP)");
+	hwcap = get_auxv(AT_HWCAP, "hwcap");
 
 	for (i = 0; caps[i].cap.name != NULL; i++)
 		if ((hwcap & caps[i].hwcap) == caps[i].hwcap)
@@ -53,14 +54,60 @@ caps_all(void)
 		register_cap(&caps[i].cap);
 }
 
-void
+int
 print_cflags(void)
 {
 	const struct cap *lvl;
 
 	lvl = get_archlevel();
-	if (lvl != NULL)
-		printf("-march=%s\n", lvl->name);
+	if (lvl == NULL)
+		return (0);
+
+	printf("-march=%s\n", lvl->name);
+
+	return (1);
+}
+
+void
+print_coretypes(void)
+{
+}
+
+void
+print_pmu(void)
+{
+}
+
+void
+dump_inputs(void)
+{
+	printf("hwcap 0x%016lx\n", get_auxv(AT_HWCAP, "hwcap"));
+}
+
+/*
+ * Sv39 page tables provide 4K pages as well as 2M and 1G leaves.
+ * Sv48 and Sv57 add larger leaves, but user space cannot tell which
+ * paging mode is in use.
+ */
+size_t
+get_pagesizes(size_t sizes[], size_t n)
+{
+	size_t i = 0;
+
+	assert(n >= 3);
+	sizes[i++] = 4096;
+	sizes[i++] = 2 * 1024 * 1024;
+	sizes[i++] = 1024 * 1024 * 1024;
+
+	return (i);
+}
+
+/* there is only one translation granule, 4K */
+size_t
+get_granules(size_t sizes[], size_t n)
+{
+
+	return (0);
 }
 
 static struct hwcap archlevel = {
@@ -123,3 +170,42 @@ get_archlevel(void)
 
 	return (&archlevel.cap);
 }
+#else /* LIBHWCAP */
+/*
+ * Function dispatch, see hwcap_resolve(3) and resolve.h.  Only the
+ * capabilities from AT_HWCAP are known.  As on aarch64, ifunc
+ * resolvers are passed it and call hwcap_resolve_auxv(), so
+ * hwcap_resolve() is free to get it from elf_aux_info(3).
+ */
+static int
+resolve_have(const char *name, size_t len, const void *arg)
+{
+	const unsigned long *hwcap = arg;
+	size_t i;
+
+	for (i = 0; caps[i].cap.name != NULL; i++)
+		if (resolve_name_is(caps[i].cap.name, name, len))
+			return ((*hwcap & caps[i].hwcap) == caps[i].hwcap);
+
+	return (0);
+}
+
+hwcap_fn
+hwcap_resolve_auxv(const struct hwcap_candidate *cand, unsigned long hwcap,
+    unsigned long hwcap2)
+{
+	cand = resolve_match(cand, resolve_have, &hwcap);
+
+	return (cand != NULL ? cand->fn : NULL);
+}
+
+hwcap_fn
+hwcap_resolve(const struct hwcap_candidate *cand)
+{
+	unsigned long hwcap = 0;
+
+	elf_aux_info(AT_HWCAP, &hwcap, sizeof(hwcap));
+
+	return (hwcap_resolve_auxv(cand, hwcap, 0));
+}
+#endif /* LIBHWCAP */
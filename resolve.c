@@ -0,0 +1,61 @@
+#include <stddef.h>
+
+#include "hwcap_resolve.h"
+#include "resolve.h"
+
+/* candidate matching for hwcap_resolve(), see resolve.h */
+
+/* is the len characters long name the capability named cap? */
+int
+resolve_name_is(const char *cap, const char *name, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		if (cap[i] != name[i])
+			return (0);
+
+	return (cap[len] == '\0');
+}
+
+static int
+is_separator(char c)
+{
+	return (c == ' ' || c == '\t' || c == ',');
+}
+
+/*
+ * Return the first candidate all of whose required capabilities are
+ * supported according to have(), or NULL if there is none.
+ */
+const struct hwcap_candidate *
+resolve_match(const struct hwcap_candidate *cand,
+    int (*have)(const char *, size_t, const void *), const void *arg)
+{
+	const char *p;
+	size_t len;
+
+	for (; cand->fn != NULL; cand++) {
+		p = cand->requires;
+		if (p == NULL)
+			return (cand);
+
+		for (;;) {
+			while (is_separator(*p))
+				p++;
+
+			if (*p == '\0')
+				return (cand);
+
+			for (len = 0; p[len] != '\0' && !is_separator(p[len]); len++)
+				;
+
+			if (!have(p, len, arg))
+				break;
+
+			p += len;
+		}
+	}
+
+	return (NULL);
+}
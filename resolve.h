@@ -0,0 +1,20 @@
+/*
+ * Candidate matching for hwcap_resolve(3), shared by all architectures
+ * and private to libhwcap.  hwcap_resolve() may run from an ifunc
+ * resolver before the functions it calls have been bound, so neither
+ * resolve.c nor the dispatch code of hwcap_$arch.c may call into libc
+ * on the way from an ifunc resolver.
+ */
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+#include <stddef.h>
+
+struct hwcap_candidate;
+
+/* provided by resolve.c */
+int	resolve_name_is(const char *, const char *, size_t);
+const struct hwcap_candidate	*resolve_match(const struct hwcap_candidate *,
+	    int (*)(const char *, size_t, const void *), const void *);
+
+#endif /* RESOLVE_H */
@@ -0,0 +1,80 @@
+#!/bin/sh
+# Benchmarks of hwcap itself: start-up time of a query and throughput
+# of capability expressions evaluated by a single hwcap -e process.
+# Both are checked against the relative budgets in bench.budget, so
+# the results do not depend on how fast the machine is.
+# usage: bench.sh hwcap [runs [queries]]
+
+hwcap=$1
+runs=${2:-1000}
+queries=${3:-100000}
+budget=$(dirname "$0")/bench.budget
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+# seconds taken by the given command, as measured by time -p
+seconds()
+{
+	env time -p "$@" 2>&1 >/dev/null | awk '$1 == "real" { print $2 }'
+}
+
+# the argument quoted for sh
+quote()
+{
+	printf "'%s'" "$(printf '%s' "$1" | sed "s/'/'\\\\''/g")"
+}
+
+# write a script running the given command runs times
+repeat()
+{
+	i=0
+	while [ $i -lt $runs ]; do
+		echo "$*"
+		i=$((i + 1))
+	done
+}
+
+# value of the named budget
+get_budget()
+{
+	awk -v key="$1" '$1 == key { print $2 }' "$budget"
+}
+
+repeat "$(quote "$hwcap") -q" >"$tmp/startup.sh"
+repeat /usr/bin/true >"$tmp/true.sh"
+
+t=$(seconds sh "$tmp/startup.sh")
+t0=$(seconds sh "$tmp/true.sh")
+echo "startup $runs $t" | awk '{ printf "%-15s %8.1f us/run\n", $1, $3 * 1e6 / $2 }'
+
+# expressions over all capabilities known, cycling through them
+"$hwcap" -a -f | tr ' ' '\n' | awk -v n=$queries '
+	{ cap[NR - 1] = $0 }
+	END {
+		for (i = 0; i < n; i++)
+			printf "%s && !(%s || %s)\n", cap[i % NR], cap[(i + 1) % NR], cap[(i + 7) % NR]
+	}' >"$tmp/exprs"
+
+echo "$(quote "$hwcap") -e <$(quote "$tmp/exprs")" >"$tmp/queries.sh"
+tq=$(seconds sh "$tmp/queries.sh")
+echo "queries $queries $tq" | awk '{ printf "%-15s %8.0f queries/s\n", $1, ($3 > 0 ? $2 / $3 : 0) }'
+
+# start-up time relative to true(1), queries answered per start-up
+echo "$runs $t $t0 $queries $tq $(get_budget startup_ratio) $(get_budget queries_per_startup)" | awk '
+	{
+		ratio = $3 > 0 ? $2 / $3 : 0
+		per = $5 > 0 ? $4 / $5 * $2 / $1 : 0
+		printf "%-15s %8.2f (budget %s)\n", "startup_ratio", ratio, $6
+		printf "%-15s %8.0f (budget %s)\n", "queries_per_startup", per, $7
+		if (ratio > $6) {
+			print "startup exceeds budget" >"/dev/stderr"
+			fail = 1
+		}
+
+		if (per < $7) {
+			print "queries fall short of budget" >"/dev/stderr"
+			fail = 1
+		}
+
+		exit fail
+	}'
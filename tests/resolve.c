@@ -0,0 +1,92 @@
+/*
+ * Unit tests of resolve_match(), the candidate matching of
+ * hwcap_resolve(3), against a fixed set of capabilities.
+ */
+#include <stdio.h>
+
+#include "hwcap_resolve.h"
+#include "resolve.h"
+
+static const char *const known[] = { "avx2", "fma", "sse4_2", NULL };
+
+static int
+have(const char *name, size_t len, const void *arg)
+{
+	size_t i;
+
+	for (i = 0; known[i] != NULL; i++)
+		if (resolve_name_is(known[i], name, len))
+			return (1);
+
+	return (0);
+}
+
+static void fn_a(void) {}
+static void fn_b(void) {}
+
+static const struct test {
+	const char *descr;
+	const char *requires;	/* of the first candidate, fn_a */
+	hwcap_fn want;		/* the second one, fn_b, requires nothing */
+} tests[] = {
+	"no requirements", NULL, fn_a,
+	"empty requirement list", "", fn_a,
+	"only separators", " ,\t, ", fn_a,
+	"one known name", "avx2", fn_a,
+	"unknown name", "avx512f", fn_b,
+	"known and unknown name", "avx2 avx512f", fn_b,
+	"prefix of a known name", "avx", fn_b,
+	"known name with suffix", "avx2x", fn_b,
+	"blank separated", "avx2 fma", fn_a,
+	"comma separated", "avx2,fma", fn_a,
+	"tab separated", "avx2\tfma", fn_a,
+	"repeated separators", " avx2 ,\tfma, ", fn_a,
+	"separators around unknown", ", avx2 ,avx512f,", fn_b,
+};
+
+int
+main(void)
+{
+	struct hwcap_candidate cand[3];
+	const struct hwcap_candidate *match;
+	hwcap_fn got;
+	size_t i;
+	int fail = 0, total = 0;
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		cand[0].requires = tests[i].requires;
+		cand[0].fn = fn_a;
+		cand[1].requires = NULL;
+		cand[1].fn = fn_b;
+		cand[2].requires = NULL;
+		cand[2].fn = NULL;
+
+		match = resolve_match(cand, have, NULL);
+		got = match != NULL ? match->fn : NULL;
+
+		total++;
+		if (got == tests[i].want) {
+			printf("ok %d - %s\n", total, tests[i].descr);
+		} else {
+			printf("not ok %d - %s\n", total, tests[i].descr);
+			fail++;
+		}
+	}
+
+	/* no candidate matches */
+	cand[0].requires = "avx512f";
+	cand[0].fn = fn_a;
+	cand[1].requires = NULL;
+	cand[1].fn = NULL;
+	total++;
+	if (resolve_match(cand, have, NULL) == NULL) {
+		printf("ok %d - no match\n", total);
+	} else {
+		printf("not ok %d - no match\n", total);
+		fail++;
+	}
+
+	printf("%d/%d passed\n", total - fail, total);
+
+	return (fail == 0 ? 0 : 1);
+}
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Regression tests: replay each fixture of the architecture with -r and
+# compare the output of -f, -l, -c, -T, -P, and -p with the expected output.
+# -e evaluates the expressions in exprs, shared by all architectures.
+# usage: run.sh hwcap fixturedir
+
+hwcap=$1
+dir=$2
+fail=0
+total=0
+
+if [ ! -d "$dir" ]; then
+	echo "no fixtures in $dir"
+	exit 0
+fi
+
+for rec in "$dir"/*.rec; do
+	name=${rec%.rec}
+	for mode in f l c T P p e; do
+		total=$((total + 1))
+		if "$hwcap" -r "$rec" -$mode <"$dir/../exprs" 2>/dev/null |
+		    diff -u "$name.$mode.out" -; then
+			echo "ok $total - ${name##*/} -$mode"
+		else
+			echo "not ok $total - ${name##*/} -$mode"
+			fail=$((fail + 1))
+		fi
+	done
+done
+
+echo "$((total - fail))/$total passed"
+[ $fail -eq 0 ]